@@ -0,0 +1,117 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef ARENA_H
+#define ARENA_H
+
+
+//== INCLUDES =================================================================
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
+#include <cstddef>
+#include <algorithm>
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class Arena Arena.h
+/// A monotonic allocator: objects are placed one after another into large
+/// blocks and are only destroyed (in reverse order) together with the arena.
+/// Objects created by the same arena therefore lie close to each other in
+/// memory, and creating them does not cost one heap allocation each.
+class Arena
+{
+public:
+
+    /// Construct an arena that allocates blocks of \c _block_size bytes
+    explicit Arena(size_t _block_size = 64 * 1024) : block_size_(_block_size) {}
+
+    /// Destroy all objects and free the blocks
+    ~Arena()
+    {
+        for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it)
+            it->second(it->first);
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /// Construct an object of type \c T from \c _args inside the arena
+    template <class T, class... Args>
+    T* create(Args&&... _args)
+    {
+        T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(_args)...);
+        destructors_.emplace_back(object, [](void* p) { static_cast<T*>(p)->~T(); });
+        return object;
+    }
+
+    /// Bytes reserved by the arena's blocks
+    size_t capacity() const { return capacity_; }
+
+private:
+
+    /// reserve \c _size bytes aligned to \c _alignment
+    void* allocate(size_t _size, size_t _alignment)
+    {
+        auto align = [_alignment](char* p) {
+            const size_t misalignment = reinterpret_cast<size_t>(p) % _alignment;
+            return misalignment ? p + (_alignment - misalignment) : p;
+        };
+
+        // try to fit the object into the current block
+        if (!blocks_.empty())
+        {
+            char* base = blocks_.back().get();
+            char* p    = align(base + used_);
+            if (p + _size <= base + block_capacity_)
+            {
+                used_ = size_t(p + _size - base);
+                return p;
+            }
+        }
+
+        // start a new block
+        block_capacity_ = std::max(block_size_, _size + _alignment);
+        blocks_.emplace_back(new char[block_capacity_]);
+        capacity_ += block_capacity_;
+
+        char* base = blocks_.back().get();
+        char* p    = align(base);
+        used_ = size_t(p + _size - base);
+        return p;
+    }
+
+private:
+
+    /// default size of a block
+    size_t block_size_;
+
+    /// size of the current block and bytes used in it
+    size_t block_capacity_ = 0;
+    size_t used_ = 0;
+
+    /// total bytes of all blocks
+    size_t capacity_ = 0;
+
+    /// the blocks
+    std::vector<std::unique_ptr<char[]>> blocks_;
+
+    /// objects with their destructors, in order of creation
+    std::vector<std::pair<void*, void(*)(void*)>> destructors_;
+};
+
+
+//=============================================================================
+#endif // ARENA_H defined
+//=============================================================================
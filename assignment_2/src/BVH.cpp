@@ -0,0 +1,613 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== INCLUDES =================================================================
+
+#include "BVH.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#  include <unistd.h>
+#endif
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+static_assert(sizeof(BVH::Node) == 64, "BVH nodes have to fit into a cache line");
+
+// number of bins used to evaluate the surface area heuristic
+static const int NUM_BINS = 12;
+
+// below this depth, splits fall back to the median to bound the tree depth
+// (and with it the traversal stack)
+static const int MAX_SAH_DEPTH = 16;
+
+// Header of a saved hierarchy, followed by the nodes and the primitive order.
+// build_parameters changes whenever the builder would produce another tree.
+struct BVHFileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t node_size;
+    uint64_t build_parameters;
+    uint64_t key;
+    uint64_t num_primitives;
+    uint64_t num_nodes;
+    uint64_t node_offset;
+    uint64_t order_offset;
+};
+
+static const char     bvh_magic[8] = { 'R', 'T', 'B', 'V', 'H', 0, 0, 0 };
+static const uint32_t bvh_version  = 1;
+static const uint64_t bvh_build_parameters =
+    uint64_t(BVH::WIDTH) | uint64_t(BVH::MAX_LEAF_SIZE) << 8 |
+    uint64_t(NUM_BINS) << 16 | uint64_t(MAX_SAH_DEPTH) << 24;
+
+
+//-----------------------------------------------------------------------------
+
+
+// half the surface area of the box [_min, _max]
+static double half_area(const vec3& _min, const vec3& _max)
+{
+    const vec3 d = _max - _min;
+    return d[0]*d[1] + d[1]*d[2] + d[2]*d[0];
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+std::vector<uint32_t> BVH::build(const std::vector<vec3>& _bb_min,
+                                 const std::vector<vec3>& _bb_max)
+{
+    lazy_.reset();
+    file_.reset();
+    nodes_.clear();
+    node_data_ = nullptr;
+    num_nodes_ = 0;
+    order_.resize(_bb_min.size());
+    if (_bb_min.empty()) return order_;
+
+    // leaves pack their first primitive into 27 bits
+    if (_bb_min.size() >= (1u << 27) - 1)
+        throw std::runtime_error("BVH: too many primitives");
+
+    bb_min_ = &_bb_min;
+    bb_max_ = &_bb_max;
+    centroids_.resize(_bb_min.size());
+    for (uint32_t i = 0; i < order_.size(); ++i)
+    {
+        order_[i]     = i;
+        centroids_[i] = 0.5 * (_bb_min[i] + _bb_max[i]);
+    }
+
+    nodes_.reserve(order_.size() / 3 + 1);
+    build_node(0, uint32_t(order_.size()), 0, nodes_, 0);
+    nodes_.shrink_to_fit();
+    node_data_ = nodes_.data();
+    num_nodes_ = nodes_.size();
+
+    std::vector<uint32_t> order;
+    order.swap(order_);
+    centroids_ = std::vector<vec3>();
+    bb_min_ = bb_max_ = nullptr;
+    return order;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+uint64_t BVH::content_hash(const std::vector<vec3>& _bb_min,
+                          const std::vector<vec3>& _bb_max)
+{
+    // multiply-xorshift over the bit patterns of all coordinates
+    uint64_t h = 0x243f6a8885a308d3ull ^ _bb_min.size();
+    auto mix = [&h](double _x) {
+        uint64_t bits;
+        std::memcpy(&bits, &_x, sizeof(bits));
+        h = (h ^ bits) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 29;
+    };
+    for (size_t i = 0; i < _bb_min.size(); ++i)
+    {
+        for (int j = 0; j < 3; ++j) mix(_bb_min[i][j]);
+        for (int j = 0; j < 3; ++j) mix(_bb_max[i][j]);
+    }
+    return h;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool BVH::save(const std::string& _filename, uint64_t _key,
+               const std::vector<uint32_t>& _order) const
+{
+    if (lazy_ || !node_data_) return false;
+
+    BVHFileHeader h = {};
+    std::copy(bvh_magic, bvh_magic + 8, h.magic);
+    h.version          = bvh_version;
+    h.node_size        = sizeof(Node);
+    h.build_parameters = bvh_build_parameters;
+    h.key              = _key;
+    h.num_primitives   = _order.size();
+    h.num_nodes        = num_nodes_;
+    h.node_offset      = sizeof(h);
+    h.order_offset     = h.node_offset + num_nodes_ * sizeof(Node);
+
+#ifdef _WIN32
+    const std::string temporary = _filename + ".tmp";
+#else
+    const std::string temporary = _filename + ".tmp" + std::to_string(getpid());
+#endif
+    {
+        std::ofstream ofs(temporary, std::ofstream::binary);
+        ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        ofs.write(reinterpret_cast<const char*>(node_data_), num_nodes_ * sizeof(Node));
+        ofs.write(reinterpret_cast<const char*>(_order.data()), _order.size() * sizeof(uint32_t));
+        if (!ofs)
+        {
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    return std::rename(temporary.c_str(), _filename.c_str()) == 0;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool BVH::valid_nodes(const Node* _nodes, size_t _num_nodes, size_t _num_primitives)
+{
+    for (size_t n = 0; n < _num_nodes; ++n)
+        for (uint32_t c : _nodes[n].child)
+        {
+            const bool valid = (c == EMPTY) ||
+                (is_leaf(c) ? leaf_first(c) + leaf_count(c) <= _num_primitives
+                            : !(c & LEAF_BIT) && c > n && c < _num_nodes);
+            if (!valid) return false;
+        }
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool BVH::load(const std::string& _filename, uint64_t _key, size_t _num_primitives,
+               std::vector<uint32_t>& _order)
+{
+    ProfileScope scope("load cached BVH", _filename);
+    std::shared_ptr<const MappedFile> file;
+    try
+    {
+        file = std::make_shared<MappedFile>(_filename);
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+
+    BVHFileHeader h;
+    if (file->size() < sizeof(h)) return false;
+    std::copy(file->data(), file->data() + sizeof(h), reinterpret_cast<char*>(&h));
+    if (!std::equal(bvh_magic, bvh_magic + 8, h.magic) || h.version != bvh_version ||
+        h.node_size != sizeof(Node) || h.build_parameters != bvh_build_parameters ||
+        h.key != _key || h.num_primitives != _num_primitives || h.num_nodes == 0 ||
+        h.node_offset % alignof(Node) ||
+        h.order_offset != h.node_offset + h.num_nodes * sizeof(Node) ||
+        h.order_offset + h.num_primitives * sizeof(uint32_t) != file->size())
+        return false;
+
+    // a damaged file is rebuilt: the order has to be a permutation and the
+    // nodes must not lead traversal or refit() out of range
+    const uint32_t* order = reinterpret_cast<const uint32_t*>(file->data() + h.order_offset);
+    std::vector<bool> seen(h.num_primitives, false);
+    for (uint64_t i = 0; i < h.num_primitives; ++i)
+    {
+        if (order[i] >= h.num_primitives || seen[order[i]]) return false;
+        seen[order[i]] = true;
+    }
+    const Node* nodes = reinterpret_cast<const Node*>(file->data() + h.node_offset);
+    if (!valid_nodes(nodes, h.num_nodes, h.num_primitives)) return false;
+
+    _order.assign(order, order + h.num_primitives);
+    attach(nodes, h.num_nodes);
+    file_ = file;
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void BVH::build_lazy(size_t _num_primitives,
+                     std::function<void(std::vector<vec3>&, std::vector<vec3>&)> _compute_bounds)
+{
+    if (_num_primitives >= (1u << 27) - 1)
+        throw std::runtime_error("BVH: too many primitives");
+
+    nodes_     = std::vector<Node>();
+    node_data_ = nullptr;
+    num_nodes_ = 0;
+    order_     = std::vector<uint32_t>();
+    bb_min_    = bb_max_ = nullptr;
+    centroids_ = std::vector<vec3>();
+
+    file_.reset();
+    lazy_.reset(new LazyState);
+    lazy_->num_primitives = _num_primitives;
+    lazy_->compute_bounds = _compute_bounds;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+const BVH::Node* BVH::lazy_top() const
+{
+    // building on demand does not change what the hierarchy represents
+    BVH* self = const_cast<BVH*>(this);
+    LazyState& lazy = *lazy_;
+
+    std::call_once(lazy.once, [self, &lazy]() {
+        if (!lazy.num_primitives) return;
+        ProfileScope scope("build lazy BVH top");
+
+        lazy.compute_bounds(lazy.bb_min, lazy.bb_max);
+        self->bb_min_ = &lazy.bb_min;
+        self->bb_max_ = &lazy.bb_max;
+        self->order_.resize(lazy.num_primitives);
+        self->centroids_.resize(lazy.num_primitives);
+        for (uint32_t i = 0; i < self->order_.size(); ++i)
+        {
+            self->order_[i]     = i;
+            self->centroids_[i] = 0.5 * (lazy.bb_min[i] + lazy.bb_max[i]);
+        }
+
+        self->build_node(0, uint32_t(lazy.num_primitives), 0, self->nodes_, LAZY_SUBTREE_SIZE);
+        self->nodes_.shrink_to_fit();
+        self->node_data_ = self->nodes_.data();
+        self->num_nodes_ = self->nodes_.size();
+    });
+    return node_data_;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+const BVH::Node* BVH::lazy_subtree(uint32_t _c) const
+{
+    // subtrees own disjoint ranges of order_, so they can be built concurrently
+    BVH* self = const_cast<BVH*>(this);
+    LazySubtree& subtree = *lazy_->subtrees[leaf_first(_c)];
+
+    std::call_once(subtree.once, [self, &subtree]() {
+        ProfileScope scope("build lazy BVH subtree");
+        subtree.nodes.reserve((subtree.end - subtree.begin) / 3 + 1);
+        self->build_node(subtree.begin, subtree.end, subtree.depth, subtree.nodes, 0);
+        subtree.nodes.shrink_to_fit();
+    });
+    return subtree.nodes.data();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+size_t BVH::memory() const
+{
+    size_t bytes = nodes_.capacity()     * sizeof(Node)
+                 + order_.capacity()     * sizeof(uint32_t)
+                 + centroids_.capacity() * sizeof(vec3);
+    if (lazy_)
+    {
+        // call only while no traversal builds subtrees
+        bytes += (lazy_->bb_min.capacity() + lazy_->bb_max.capacity()) * sizeof(vec3);
+        for (const auto& subtree : lazy_->subtrees)
+            bytes += sizeof(LazySubtree) + subtree->nodes.capacity() * sizeof(Node);
+    }
+    return bytes;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void BVH::range_bounds(uint32_t _begin, uint32_t _end, vec3& _min, vec3& _max) const
+{
+    _min = vec3(std::numeric_limits<double>::max());
+    _max = vec3(std::numeric_limits<double>::lowest());
+    for (uint32_t i = _begin; i < _end; ++i)
+    {
+        _min = min(_min, (*bb_min_)[order_[i]]);
+        _max = max(_max, (*bb_max_)[order_[i]]);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+uint32_t BVH::split(uint32_t _begin, uint32_t _end, bool _use_sah)
+{
+    // choose the axis of largest centroid extent
+    vec3 c_min(std::numeric_limits<double>::max());
+    vec3 c_max(std::numeric_limits<double>::lowest());
+    for (uint32_t i = _begin; i < _end; ++i)
+    {
+        c_min = min(c_min, centroids_[order_[i]]);
+        c_max = max(c_max, centroids_[order_[i]]);
+    }
+    const vec3 extent = c_max - c_min;
+    int axis = 0;
+    if (extent[1] > extent[axis]) axis = 1;
+    if (extent[2] > extent[axis]) axis = 2;
+
+    const uint32_t middle = _begin + (_end - _begin) / 2;
+    auto median_split = [&]() {
+        std::nth_element(order_.begin() + _begin, order_.begin() + middle, order_.begin() + _end,
+                         [&](uint32_t a, uint32_t b) { return centroids_[a][axis] < centroids_[b][axis]; });
+        return middle;
+    };
+
+    if (extent[axis] <= 0.0 || !_use_sah) return median_split();
+
+    // bin the centroids
+    const double k = NUM_BINS * (1.0 - 1e-6) / extent[axis];
+    auto bin_of = [&](uint32_t prim) {
+        return std::min(NUM_BINS - 1, int(k * (centroids_[prim][axis] - c_min[axis])));
+    };
+
+    unsigned int count[NUM_BINS] = {};
+    vec3 b_min[NUM_BINS], b_max[NUM_BINS];
+    for (int b = 0; b < NUM_BINS; ++b)
+    {
+        b_min[b] = vec3(std::numeric_limits<double>::max());
+        b_max[b] = vec3(std::numeric_limits<double>::lowest());
+    }
+    for (uint32_t i = _begin; i < _end; ++i)
+    {
+        const uint32_t prim = order_[i];
+        const int b = bin_of(prim);
+        ++count[b];
+        b_min[b] = min(b_min[b], (*bb_min_)[prim]);
+        b_max[b] = max(b_max[b], (*bb_max_)[prim]);
+    }
+
+    // sweep from the right to get the cost of all right-hand sides
+    double right_cost[NUM_BINS];
+    vec3 r_min(std::numeric_limits<double>::max());
+    vec3 r_max(std::numeric_limits<double>::lowest());
+    unsigned int r_count = 0;
+    for (int b = NUM_BINS - 1; b > 0; --b)
+    {
+        r_min = min(r_min, b_min[b]);
+        r_max = max(r_max, b_max[b]);
+        r_count += count[b];
+        right_cost[b] = r_count ? r_count * half_area(r_min, r_max) : 0.0;
+    }
+
+    // sweep from the left and pick the cheapest boundary
+    vec3 l_min(std::numeric_limits<double>::max());
+    vec3 l_max(std::numeric_limits<double>::lowest());
+    unsigned int l_count = 0;
+    double best_cost = std::numeric_limits<double>::max();
+    int    best_bin  = -1;
+    for (int b = 1; b < NUM_BINS; ++b)
+    {
+        l_min = min(l_min, b_min[b-1]);
+        l_max = max(l_max, b_max[b-1]);
+        l_count += count[b-1];
+        if (l_count == 0 || l_count == _end - _begin) continue;
+
+        const double cost = l_count * half_area(l_min, l_max) + right_cost[b];
+        if (cost < best_cost)
+        {
+            best_cost = cost;
+            best_bin  = b;
+        }
+    }
+    if (best_bin < 0) return median_split();
+
+    auto it = std::partition(order_.begin() + _begin, order_.begin() + _end,
+                             [&](uint32_t prim) { return bin_of(prim) < best_bin; });
+    return uint32_t(it - order_.begin());
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void BVH::quantize(Node& _node, const vec3* _c_min, const vec3* _c_max, int _num_children)
+{
+    // the node's quantization frame encloses all children
+    vec3 n_min(std::numeric_limits<double>::max());
+    vec3 n_max(std::numeric_limits<double>::lowest());
+    for (int c = 0; c < _num_children; ++c)
+    {
+        n_min = min(n_min, _c_min[c]);
+        n_max = max(n_max, _c_max[c]);
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        float origin = float(n_min[i]);
+        if (double(origin) > n_min[i])
+            origin = std::nextafter(origin, -std::numeric_limits<float>::infinity());
+
+        float scale = float(std::max((n_max[i] - origin) / 255.0, double(std::numeric_limits<float>::min())));
+        while (dequantize(origin, scale, 255) < n_max[i])
+            scale = std::nextafter(scale, std::numeric_limits<float>::infinity());
+
+        _node.origin[i] = origin;
+        _node.scale[i]  = scale;
+
+        for (int c = 0; c < WIDTH; ++c)
+        {
+            if (c >= _num_children)
+            {
+                _node.lo[i][c] = _node.hi[i][c] = 0;
+                continue;
+            }
+
+            int lo = std::max(0,   int(std::floor((_c_min[c][i] - origin) / scale)));
+            int hi = std::min(255, int(std::ceil ((_c_max[c][i] - origin) / scale)));
+            while (lo > 0   && dequantize(origin, scale, uint8_t(lo)) > _c_min[c][i]) --lo;
+            while (hi < 255 && dequantize(origin, scale, uint8_t(hi)) < _c_max[c][i]) ++hi;
+            _node.lo[i][c] = uint8_t(lo);
+            _node.hi[i][c] = uint8_t(hi);
+        }
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+BVH::Node BVH::make_node(const uint32_t* _children, const vec3* _c_min, const vec3* _c_max,
+                        int _num_children)
+{
+    Node node;
+    quantize(node, _c_min, _c_max, _num_children);
+    for (int c = 0; c < WIDTH; ++c)
+        node.child[c] = (c < _num_children) ? _children[c] : EMPTY;
+    return node;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void BVH::refit(const std::vector<vec3>& _bb_min, const std::vector<vec3>& _bb_max)
+{
+    ProfileScope scope("refit BVH");
+    if (lazy_ || !node_data_)
+        throw std::logic_error("BVH: only built hierarchies can be refit");
+
+    // attached nodes are read-only, refit a copy
+    if (node_data_ != nodes_.data())
+    {
+        nodes_.assign(node_data_, node_data_ + num_nodes_);
+        node_data_ = nodes_.data();
+        file_.reset();
+    }
+
+    // children are stored after their parents, so a reverse sweep visits
+    // them before the nodes that enclose them
+    std::vector<vec3> node_min(nodes_.size()), node_max(nodes_.size());
+    for (size_t n = nodes_.size(); n-- > 0; )
+    {
+        Node& node = nodes_[n];
+        vec3 c_min[WIDTH], c_max[WIDTH];
+        int num_children = 0;
+        for (; num_children < WIDTH && node.child[num_children] != EMPTY; ++num_children)
+        {
+            const int      c     = num_children;
+            const uint32_t child = node.child[c];
+            if (is_leaf(child))
+            {
+                c_min[c] = vec3(std::numeric_limits<double>::max());
+                c_max[c] = vec3(std::numeric_limits<double>::lowest());
+                for (uint32_t i = leaf_first(child); i < leaf_first(child) + leaf_count(child); ++i)
+                {
+                    c_min[c] = min(c_min[c], _bb_min[i]);
+                    c_max[c] = max(c_max[c], _bb_max[i]);
+                }
+            }
+            else
+            {
+                c_min[c] = node_min[child];
+                c_max[c] = node_max[child];
+            }
+            node_min[n] = c ? min(node_min[n], c_min[c]) : c_min[c];
+            node_max[n] = c ? max(node_max[n], c_max[c]) : c_max[c];
+        }
+        quantize(node, c_min, c_max, num_children);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+uint32_t BVH::build_node(uint32_t _begin, uint32_t _end, int _depth,
+                         std::vector<Node>& _nodes, uint32_t _lazy_size)
+{
+    // split the range into up to WIDTH children, always splitting the largest one
+    uint32_t ranges[WIDTH][2] = { { _begin, _end } };
+    int num_children = 1;
+    while (num_children < WIDTH)
+    {
+        int largest = 0;
+        for (int c = 1; c < num_children; ++c)
+            if (ranges[c][1] - ranges[c][0] > ranges[largest][1] - ranges[largest][0])
+                largest = c;
+
+        const uint32_t b = ranges[largest][0], e = ranges[largest][1];
+        if (e - b <= MAX_LEAF_SIZE) break;
+
+        const uint32_t m = split(b, e, _depth < MAX_SAH_DEPTH);
+
+        ranges[largest][1] = m;
+        ranges[num_children][0] = m;
+        ranges[num_children][1] = e;
+        ++num_children;
+    }
+
+    // compute the children's bounds
+    vec3 c_min[WIDTH], c_max[WIDTH];
+    for (int c = 0; c < num_children; ++c)
+        range_bounds(ranges[c][0], ranges[c][1], c_min[c], c_max[c]);
+
+    const uint32_t index = uint32_t(_nodes.size());
+    _nodes.push_back(Node());
+    Node node;
+    quantize(node, c_min, c_max, num_children);
+
+    // create leaves or recurse
+    for (int c = 0; c < WIDTH; ++c)
+    {
+        if (c >= num_children)
+            node.child[c] = EMPTY;
+        else if (ranges[c][1] - ranges[c][0] <= MAX_LEAF_SIZE)
+            node.child[c] = LEAF_BIT | (ranges[c][0] << 4) | (ranges[c][1] - ranges[c][0]);
+        else if (ranges[c][1] - ranges[c][0] <= _lazy_size)
+        {
+            // a subtree to be built on first use, referenced by a zero-sized leaf
+            LazySubtree* subtree = new LazySubtree;
+            subtree->begin = ranges[c][0];
+            subtree->end   = ranges[c][1];
+            subtree->depth = _depth + 1;
+            node.child[c]  = LEAF_BIT | (uint32_t(lazy_->subtrees.size()) << 4);
+            lazy_->subtrees.push_back(std::unique_ptr<LazySubtree>(subtree));
+        }
+        else
+            node.child[c] = build_node(ranges[c][0], ranges[c][1], _depth + 1, _nodes, _lazy_size);
+    }
+
+    _nodes[index] = node;
+    return index;
+}
+
+
+//=============================================================================
@@ -0,0 +1,421 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef BVH_H
+#define BVH_H
+
+
+//== INCLUDES =================================================================
+
+#include "Ray.h"
+#include "vec3.h"
+#include "simd.h"
+
+#include "MappedFile.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class BVH BVH.h
+/// A compact bounding volume hierarchy over a set of primitives, e.g. the
+/// triangles of a Mesh. Every node has up to four children and fits into one
+/// 64 byte cache line: the node stores the frame of its own bounding box in
+/// single precision, and the children's boxes are quantized to 8 bits per
+/// coordinate relative to that frame. The quantized boxes are conservative,
+/// i.e., they always enclose the exact child boxes.
+///
+/// Leaves reference contiguous ranges of primitives. build() returns the
+/// permutation that the owner has to apply to its primitive array.
+///
+/// Alternatively, build_lazy() defers construction to traversal: the first
+/// traversal builds the upper levels down to subtrees of at most
+/// LAZY_SUBTREE_SIZE primitives, and each subtree is built when a ray first
+/// enters it. Leaves then refer to positions in primitive_order().
+class BVH
+{
+public:
+
+    /// maximum number of children per node
+    static const int WIDTH = 4;
+
+    /// a leaf is created as soon as a range holds at most this many primitives
+    static const unsigned int MAX_LEAF_SIZE = 4;
+
+    /// child slot is unused
+    static const uint32_t EMPTY = 0xffffffffu;
+
+    /// child slot refers to a leaf (first primitive and count are packed below),
+    /// or with a count of zero to a subtree that is not built yet
+    static const uint32_t LEAF_BIT = 0x80000000u;
+
+    /// ranges of at most this many primitives become lazily built subtrees
+    static const uint32_t LAZY_SUBTREE_SIZE = 2048;
+
+    /// a 4-wide node with quantized child bounds (64 bytes)
+    struct Node
+    {
+        /// lower corner of this node's box, rounded down to float
+        float    origin[3];
+        /// size of one quantization step per axis
+        float    scale[3];
+        /// quantized lower corners of the children (per axis, per child)
+        uint8_t  lo[3][WIDTH];
+        /// quantized upper corners of the children (per axis, per child)
+        uint8_t  hi[3][WIDTH];
+        /// child node index, leaf (LEAF_BIT | first << 4 | count), or EMPTY
+        uint32_t child[WIDTH];
+    };
+
+    /// Construct an empty hierarchy
+    BVH() {}
+
+    /// Copy a hierarchy (attached nodes are shared, built nodes are copied)
+    BVH(const BVH& _other) { *this = _other; }
+
+    /// Copy a hierarchy (attached nodes are shared, built nodes are copied).
+    /// Lazy hierarchies cannot be copied.
+    BVH& operator=(const BVH& _other)
+    {
+        if (_other.lazy_)
+            throw std::logic_error("BVH: lazy hierarchies cannot be copied");
+        lazy_.reset();
+        const bool owned = (_other.node_data_ == _other.nodes_.data());
+        nodes_     = _other.nodes_;
+        node_data_ = owned ? nodes_.data() : _other.node_data_;
+        num_nodes_ = _other.num_nodes_;
+        file_      = _other.file_;
+        return *this;
+    }
+
+    /// Build the hierarchy for primitives with the given bounding boxes.
+    /// \param[in] _bb_min lower corners of the primitives' boxes
+    /// \param[in] _bb_max upper corners of the primitives' boxes
+    /// \return order of the primitives expected by the leaves: position i of
+    /// the reordered array has to hold primitive number result[i]
+    std::vector<uint32_t> build(const std::vector<vec3>& _bb_min,
+                                const std::vector<vec3>& _bb_max);
+
+    /// Prepare lazy construction for \c _num_primitives primitives. Nothing
+    /// is built here; the first traversal calls \c _compute_bounds to get the
+    /// primitives' boxes (see build()) and builds the upper levels. The
+    /// primitives are not reordered, leaves refer to primitive_order().
+    void build_lazy(size_t _num_primitives,
+                    std::function<void(std::vector<vec3>&, std::vector<vec3>&)> _compute_bounds);
+
+    /// Hash of the primitive bounds passed to build(), used to recognize a
+    /// hierarchy built for the same input
+    static uint64_t content_hash(const std::vector<vec3>& _bb_min,
+                                 const std::vector<vec3>& _bb_max);
+
+    /// Write the built hierarchy and the permutation \c _order returned by
+    /// build() to \c _filename, tagged with \c _key (e.g. content_hash()).
+    /// The file is written under a temporary name and renamed, so concurrent
+    /// readers never see a partial file.
+    bool save(const std::string& _filename, uint64_t _key,
+              const std::vector<uint32_t>& _order) const;
+
+    /// Map a hierarchy written by save() and use its nodes in place. Returns
+    /// false, leaving the BVH unchanged, if the file does not exist, has a
+    /// different key or number of primitives, or was written with other build
+    /// parameters or node layout. Otherwise \c _order receives the
+    /// permutation that build() would have returned.
+    bool load(const std::string& _filename, uint64_t _key, size_t _num_primitives,
+              std::vector<uint32_t>& _order);
+
+    /// A node with the child slots \c _children (node indices or leaves) whose
+    /// exact bounds are \c _c_min and \c _c_max, e.g. to join hierarchies
+    /// that were built separately under common parents
+    static Node make_node(const uint32_t* _children, const vec3* _c_min, const vec3* _c_max,
+                          int _num_children);
+
+    /// Update the node boxes after the primitives moved, keeping the tree
+    /// topology. \c _bb_min and \c _bb_max are the primitives' new bounds in
+    /// leaf order, i.e., after applying the permutation returned by build().
+    void refit(const std::vector<vec3>& _bb_min, const std::vector<vec3>& _bb_max);
+
+    /// is the hierarchy built lazily?
+    bool lazy() const { return bool(lazy_); }
+
+    /// Primitive at leaf position \c _i of a lazy hierarchy
+    uint32_t primitive_order(uint32_t _i) const { return order_[_i]; }
+
+    /// Visit all leaves whose boxes are hit by \c _ray within (0, _t_max),
+    /// roughly front to back. \c _leaf(first, count) is called for every such
+    /// leaf and may decrease \c _t_max to cull farther nodes.
+    template <class LeafFunction>
+    void traverse(const Ray& _ray, double& _t_max, LeafFunction&& _leaf) const
+    {
+        const uint32_t root = 0;
+        traverse(_ray, _t_max, _leaf, &root, 1);
+    }
+
+    /// Like traverse() above, but start from the \c _num_roots child slots
+    /// \c _roots (see collect_roots()) instead of the root node.
+    template <class LeafFunction>
+    void traverse(const Ray& _ray, double& _t_max, LeafFunction&& _leaf,
+                  const uint32_t* _roots, size_t _num_roots) const;
+
+    /// Cull the hierarchy against a volume, e.g. the frustum of an image tile:
+    /// starting at the root, nodes are replaced breadth-first by those of
+    /// their children whose boxes pass \c _box_test(min, max), as long as the
+    /// list stays within \c _max_roots slots. Rays inside the volume can be
+    /// traversed from the resulting slots. An empty list means that no box
+    /// passed the test.
+    template <class BoxTest>
+    void collect_roots(BoxTest&& _box_test, size_t _max_roots, std::vector<uint32_t>& _roots) const;
+
+    /// Do the \c _num_nodes nodes only refer to nodes stored after their
+    /// parent (as refit() requires) and to leaves within \c _num_primitives?
+    /// Nodes read from files are checked with this before they are attached.
+    static bool valid_nodes(const Node* _nodes, size_t _num_nodes, size_t _num_primitives);
+
+    /// Use \c _num_nodes nodes stored elsewhere, e.g. in a memory-mapped
+    /// file, instead of building the hierarchy. The nodes have to outlive
+    /// this BVH.
+    void attach(const Node* _nodes, size_t _num_nodes)
+    {
+        lazy_.reset();
+        file_.reset();
+        nodes_ = std::vector<Node>();
+        node_data_ = _nodes;
+        num_nodes_ = _num_nodes;
+    }
+
+    /// the nodes, the root is nodes()[0]
+    const Node* nodes() const { return node_data_; }
+
+    /// number of nodes
+    size_t num_nodes() const { return num_nodes_; }
+
+    /// memory used by the nodes, the lazy subtrees built so far and the build
+    /// state kept for them in bytes (attached nodes are not counted)
+    size_t memory() const;
+
+    /// bytes of the nodes mapped by load() currently resident in memory
+    size_t resident_bytes() const { return file_ ? file_->resident_bytes() : 0; }
+
+    /// does child slot \c _c refer to a leaf?
+    static bool is_leaf(uint32_t _c) { return (_c & LEAF_BIT) && _c != EMPTY && (_c & 0xf); }
+
+    /// does child slot \c _c refer to a subtree that is built lazily?
+    static bool is_lazy(uint32_t _c) { return (_c & LEAF_BIT) && _c != EMPTY && !(_c & 0xf); }
+
+    /// index of the first primitive of leaf \c _c
+    static uint32_t leaf_first(uint32_t _c) { return (_c & ~LEAF_BIT) >> 4; }
+
+    /// number of primitives of leaf \c _c
+    static uint32_t leaf_count(uint32_t _c) { return _c & 0xf; }
+
+    /// Dequantize coordinate \c _q of a frame with \c _origin and \c _scale.
+    /// Build and traversal both use this function, so that the conservative
+    /// rounding checked during the build also holds during traversal.
+    static double dequantize(float _origin, float _scale, uint8_t _q)
+    {
+        return double(_origin) + double(_q) * double(_scale);
+    }
+
+private:
+
+    /// recursively build the node for the primitive range [_begin, _end)
+    /// into \c _nodes. Child ranges of at most \c _lazy_size primitives
+    /// become lazy subtrees (if \c _lazy_size is not zero).
+    uint32_t build_node(uint32_t _begin, uint32_t _end, int _depth,
+                        std::vector<Node>& _nodes, uint32_t _lazy_size);
+
+    /// set the quantization frame and child boxes of \c _node from the exact
+    /// bounds of its first \c _num_children children
+    static void quantize(Node& _node, const vec3* _c_min, const vec3* _c_max, int _num_children);
+
+    /// nodes of the upper levels of a lazy hierarchy, built on first use
+    const Node* lazy_top() const;
+
+    /// nodes of the lazy subtree of child slot \c _c, built on first use
+    const Node* lazy_subtree(uint32_t _c) const;
+
+    /// split [_begin, _end) along the best SAH bin boundary (or at the median
+    /// if \c _use_sah is false), return the split position
+    uint32_t split(uint32_t _begin, uint32_t _end, bool _use_sah);
+
+    /// bounds of the primitive range [_begin, _end)
+    void range_bounds(uint32_t _begin, uint32_t _end, vec3& _min, vec3& _max) const;
+
+private:
+
+    /// array of nodes built by build()
+    std::vector<Node> nodes_;
+
+    /// nodes used for traversal, either nodes_ or attached ones
+    const Node* node_data_ = nullptr;
+    size_t      num_nodes_ = 0;
+
+    /// file holding the nodes mapped by load()
+    std::shared_ptr<const MappedFile> file_;
+
+    /// primitive order while building
+    std::vector<uint32_t> order_;
+
+    /// primitive bounds and centroids while building
+    const std::vector<vec3> *bb_min_ = nullptr, *bb_max_ = nullptr;
+    std::vector<vec3> centroids_;
+
+    /// a subtree of a lazy hierarchy
+    struct LazySubtree
+    {
+        uint32_t begin, end;
+        int depth;
+        std::once_flag once;
+        std::vector<Node> nodes;
+    };
+
+    /// state of a lazy hierarchy
+    struct LazyState
+    {
+        size_t num_primitives;
+        std::function<void(std::vector<vec3>&, std::vector<vec3>&)> compute_bounds;
+        std::once_flag once;
+        std::vector<vec3> bb_min, bb_max;
+        std::vector<std::unique_ptr<LazySubtree>> subtrees;
+    };
+    std::unique_ptr<LazyState> lazy_;
+};
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+template <class LeafFunction>
+void BVH::traverse(const Ray& _ray, double& _t_max, LeafFunction&& _leaf,
+                   const uint32_t* _roots, size_t _num_roots) const
+{
+    const Node* nodes = lazy_ ? lazy_top() : node_data_;
+    if (!nodes) return;
+
+    const vec3 inv_dir(1.0 / _ray.direction[0],
+                       1.0 / _ray.direction[1],
+                       1.0 / _ray.direction[2]);
+
+    // stack of child slots together with their entry distance and the node
+    // array they refer to (lazy subtrees have their own)
+    struct Entry { uint32_t child; double t; const Node* nodes; };
+    Entry stack[128];
+    int   top = 0;
+    for (size_t i = _num_roots; i-- > 0; )
+        stack[top++] = Entry{ _roots[i], 0.0, nodes };
+
+    while (top)
+    {
+        // entries at exactly _t_max may hold a tied hit, see Mesh::intersect()
+        const Entry e = stack[--top];
+        if (e.t > _t_max) continue;
+
+        if (is_leaf(e.child))
+        {
+            _leaf(leaf_first(e.child), leaf_count(e.child));
+            continue;
+        }
+
+        // enter the root of a lazy subtree
+        const Node* base = e.nodes;
+        uint32_t    index = e.child;
+        if (is_lazy(e.child))
+        {
+            base  = lazy_subtree(e.child);
+            index = 0;
+        }
+
+        // intersect the ray with the dequantized boxes of all children at
+        // once, one lane per child (same operations as dequantize())
+        const Node& node = base[index];
+        double4 t_near(0.0), t_far(_t_max);
+        for (int i = 0; i < 3; ++i)
+        {
+            const double4 origin(node.origin[i]), scale(node.scale[i]);
+            const double4 lo = origin + double4(node.lo[i][0], node.lo[i][1], node.lo[i][2], node.lo[i][3]) * scale;
+            const double4 hi = origin + double4(node.hi[i][0], node.hi[i][1], node.hi[i][2], node.hi[i][3]) * scale;
+            const double4 t1 = (lo - double4(_ray.origin[i])) * double4(inv_dir[i]);
+            const double4 t2 = (hi - double4(_ray.origin[i])) * double4(inv_dir[i]);
+            t_near = max(min(t2, t1), t_near);
+            t_far  = min(max(t1, t2), t_far);
+        }
+        const int hit_mask = ~less(t_far, t_near);
+
+        Entry hits[WIDTH];
+        int   num_hits = 0;
+        for (int c = 0; c < WIDTH; ++c)
+        {
+            if (node.child[c] == EMPTY || !(hit_mask & (1 << c))) continue;
+
+            // insertion sort, farthest first
+            const double t = t_near[c];
+            int j = num_hits++;
+            for (; j > 0 && hits[j-1].t < t; --j) hits[j] = hits[j-1];
+            hits[j] = Entry{ node.child[c], t, base };
+        }
+
+        // push in far-to-near order so that the nearest child is popped first
+        for (int j = 0; j < num_hits; ++j)
+            stack[top++] = hits[j];
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+template <class BoxTest>
+void BVH::collect_roots(BoxTest&& _box_test, size_t _max_roots, std::vector<uint32_t>& _roots) const
+{
+    _roots.clear();
+    const Node* nodes = lazy_ ? lazy_top() : node_data_;
+    if (!nodes) return;
+    _roots.push_back(0);
+
+    // lazy subtrees are kept as they are, without building them
+    for (size_t i = 0; i < _roots.size(); )
+    {
+        const uint32_t slot = _roots[i];
+        if (is_leaf(slot) || is_lazy(slot) || _roots.size() - 1 + WIDTH > _max_roots)
+        {
+            ++i;
+            continue;
+        }
+
+        // replace the node by its children that pass the test
+        const Node& node = nodes[slot];
+        _roots.erase(_roots.begin() + i);
+        for (int c = 0; c < WIDTH; ++c)
+        {
+            if (node.child[c] == EMPTY) continue;
+            vec3 lo, hi;
+            for (int k = 0; k < 3; ++k)
+            {
+                lo[k] = dequantize(node.origin[k], node.scale[k], node.lo[k][c]);
+                hi[k] = dequantize(node.origin[k], node.scale[k], node.hi[k][c]);
+            }
+            if (_box_test(lo, hi)) _roots.push_back(node.child[c]);
+        }
+    }
+}
+
+
+//=============================================================================
+#endif // BVH_H defined
+//=============================================================================
@@ -15,6 +15,7 @@
 //== INCLUDES =================================================================
 
 #include "vec3.h"
+#include "Frustum.h"
 
 
 //== CLASS DEFINITION =========================================================
@@ -84,6 +85,26 @@ public:
         return Ray(eye, lower_left + static_cast<double>(_x)*x_dir + static_cast<double>(_y)*y_dir - eye);
     }
 
+    /// create a ray through a sub-pixel location
+	/// \param[in] _x,_y location in pixel units, primary_ray(x,y) equals subpixel_ray(x,y)
+    Ray subpixel_ray(double _x, double _y) const
+    {
+        return Ray(eye, lower_left + _x*x_dir + _y*y_dir - eye);
+    }
+
+    /// the frustum containing the rays primary_ray(x,y) of all pixels
+    /// _x0 <= x < _x1, _y0 <= y < _y1, with a margin of half a pixel
+    Frustum frustum(int _x0, int _y0, int _x1, int _y1) const
+    {
+        const double x0 = _x0 - 0.5, x1 = _x1 - 0.5;
+        const double y0 = _y0 - 0.5, y1 = _y1 - 0.5;
+        const vec3 d[4] = { lower_left + x0*x_dir + y0*y_dir - eye,
+                            lower_left + x1*x_dir + y0*y_dir - eye,
+                            lower_left + x1*x_dir + y1*y_dir - eye,
+                            lower_left + x0*x_dir + y1*y_dir - eye };
+        return Frustum(eye, d);
+    }
+
 
 public:
 
@@ -0,0 +1,290 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== INCLUDES =================================================================
+
+#include "Scene.h"
+#include "MappedFile.h"
+#include "Profiler.h"
+#include "LogStream.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+// A compiled scene (.rts) consists of a header, arrays of fixed-size records
+// for lights and primitives, and the meshes in the packed mesh format (with
+// their BVHs) at page-aligned offsets. Records are copied into the scene's
+// arrays, meshes are used in place from the mapped file.
+struct CompiledSceneHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_sizes;     // sum of the record sizes, detects layout changes
+
+    // camera
+    vec3     eye, center, up;
+    double   fovy;
+    uint32_t width, height;
+
+    // global settings
+    int32_t  max_depth;
+    int32_t  reserved;
+    vec3     background, ambience;
+
+    // number of records and their offsets from the start of the file
+    uint64_t num_lights,    lights_offset;
+    uint64_t num_planes,    planes_offset;
+    uint64_t num_spheres,   spheres_offset;
+    uint64_t num_cylinders, cylinders_offset;
+    uint64_t num_meshes,    meshes_offset;
+};
+
+struct CompiledLight    { vec3 position, color, edge_u, edge_v; double radius; int32_t shape; int32_t reserved; };
+struct CompiledPlane    { vec3 center, normal; Material material; };
+struct CompiledSphere   { vec3 center; double radius; Material material; };
+struct CompiledCylinder { vec3 center, axis; double radius, height; Material material; };
+struct CompiledMesh     { uint64_t offset; int32_t draw_mode; int32_t reserved; Material material; };
+
+static const char     compiled_magic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', 0 };
+static const uint32_t compiled_version  = 2;
+static const uint32_t compiled_record_sizes =
+    uint32_t(sizeof(CompiledSceneHeader) + sizeof(CompiledLight) + sizeof(CompiledPlane) +
+             sizeof(CompiledSphere) + sizeof(CompiledCylinder) + sizeof(CompiledMesh));
+
+static_assert(std::is_trivially_copyable<CompiledLight>::value &&
+              std::is_trivially_copyable<CompiledSceneHeader>::value &&
+              std::is_trivially_copyable<CompiledPlane>::value &&
+              std::is_trivially_copyable<CompiledSphere>::value &&
+              std::is_trivially_copyable<CompiledCylinder>::value &&
+              std::is_trivially_copyable<CompiledMesh>::value,
+              "compiled scenes are written and read byte-wise");
+
+
+//-----------------------------------------------------------------------------
+
+
+bool Scene::write_compiled(const std::string &_filename) const
+{
+    // packed meshes store one static pose, without targets and keyframes
+    if (!morph_meshes.empty())
+    {
+        std::cerr << "Compiled scenes cannot contain morph meshes\n";
+        return false;
+    }
+    for (const Mesh *m : meshes)
+    {
+        if (m->storage() != Mesh::FULL)
+        {
+            std::cerr << "Compiled scenes require full mesh storage\n";
+            return false;
+        }
+        if (m->lazy_bvh())
+        {
+            std::cerr << "Compiled scenes require eagerly built mesh BVHs\n";
+            return false;
+        }
+    }
+
+    std::ofstream ofs(_filename, std::ofstream::binary);
+    if (!ofs)
+    {
+        std::cerr << "Can't open " << _filename << "\n";
+        return false;
+    }
+
+    std::vector<CompiledLight> light_records;
+    for (const Light &l : lights)
+        light_records.push_back(CompiledLight{ l.position, l.color, l.edge_u, l.edge_v, l.radius, int32_t(l.shape), 0 });
+
+    std::vector<CompiledPlane> plane_records;
+    for (const Plane &p : planes)
+        plane_records.push_back(CompiledPlane{ p.center, p.normal, p.material });
+
+    std::vector<CompiledSphere> sphere_records;
+    for (const Sphere &s : spheres)
+        sphere_records.push_back(CompiledSphere{ s.center, s.radius, s.material });
+
+    std::vector<CompiledCylinder> cylinder_records;
+    for (const Cylinder &c : cylinders)
+        cylinder_records.push_back(CompiledCylinder{ c.center, c.axis, c.radius, c.height, c.material });
+
+    CompiledSceneHeader h = {};
+    std::copy(compiled_magic, compiled_magic + 8, h.magic);
+    h.version      = compiled_version;
+    h.record_sizes = compiled_record_sizes;
+    h.eye          = camera.eye;
+    h.center       = camera.center;
+    h.up           = camera.up;
+    h.fovy         = camera.fovy;
+    h.width        = camera.width;
+    h.height       = camera.height;
+    h.max_depth    = max_depth;
+    h.background   = background;
+    h.ambience     = ambience;
+
+    h.num_lights       = lights.size();
+    h.lights_offset    = sizeof(h);
+    h.num_planes       = plane_records.size();
+    h.planes_offset    = h.lights_offset + h.num_lights * sizeof(CompiledLight);
+    h.num_spheres      = sphere_records.size();
+    h.spheres_offset   = h.planes_offset + h.num_planes * sizeof(CompiledPlane);
+    h.num_cylinders    = cylinder_records.size();
+    h.cylinders_offset = h.spheres_offset + h.num_spheres * sizeof(CompiledSphere);
+    h.num_meshes       = meshes.size();
+    h.meshes_offset    = h.cylinders_offset + h.num_cylinders * sizeof(CompiledCylinder);
+
+    // the packed meshes follow the records, each starting at a page boundary
+    auto align = [](uint64_t offset) {
+        return (offset + Mesh::PACKED_ALIGNMENT - 1) / Mesh::PACKED_ALIGNMENT * Mesh::PACKED_ALIGNMENT;
+    };
+    std::vector<CompiledMesh> mesh_records;
+    for (const Mesh *m : meshes)
+        mesh_records.push_back(CompiledMesh{ 0, int32_t(m->draw_mode()), 0, m->material });
+    const uint64_t records_end = h.meshes_offset + h.num_meshes * sizeof(CompiledMesh);
+
+    // write the header and the records, the mesh offsets are patched below
+    ofs.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    ofs.write(reinterpret_cast<const char *>(light_records.data()), light_records.size() * sizeof(CompiledLight));
+    ofs.write(reinterpret_cast<const char *>(plane_records.data()), plane_records.size() * sizeof(CompiledPlane));
+    ofs.write(reinterpret_cast<const char *>(sphere_records.data()), sphere_records.size() * sizeof(CompiledSphere));
+    ofs.write(reinterpret_cast<const char *>(cylinder_records.data()), cylinder_records.size() * sizeof(CompiledCylinder));
+    ofs.write(reinterpret_cast<const char *>(mesh_records.data()), mesh_records.size() * sizeof(CompiledMesh));
+
+    bool written = true;
+    for (size_t i = 0; i < meshes.size() && written; ++i)
+    {
+        const uint64_t offset = align(uint64_t(ofs.tellp()));
+        while (uint64_t(ofs.tellp()) < offset) ofs.put(0);
+        mesh_records[i].offset = offset;
+        written = meshes[i]->write_packed(ofs);
+    }
+    if (written)
+    {
+        ofs.seekp(std::streamoff(h.meshes_offset));
+        ofs.write(reinterpret_cast<const char *>(mesh_records.data()), mesh_records.size() * sizeof(CompiledMesh));
+        ofs.seekp(0, std::ios::end);
+    }
+
+    // a partial file would only fail later, when it is mapped
+    if (!written || !ofs)
+    {
+        ofs.close();
+        std::remove(_filename.c_str());
+        return false;
+    }
+
+    log_stream() << "compiled " << lights.size() << " lights, " << objects.size() << " objects ("
+              << meshes.size() << " meshes), " << uint64_t(ofs.tellp()) / (1024.0*1024.0) << " MB; "
+              << records_end << " bytes of records\n";
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Scene::read_compiled(const std::string &_filename)
+{
+    ProfileScope scope("map compiled scene", _filename);
+    auto file = std::make_shared<MappedFile>(_filename);
+    const char *data = file->data();
+    const size_t size = file->size();
+
+    CompiledSceneHeader h;
+    if (size < sizeof(h))
+        throw std::runtime_error("No compiled scene: " + _filename);
+    std::copy(data, data + sizeof(h), reinterpret_cast<char *>(&h));
+
+    auto section_ok = [size](uint64_t offset, uint64_t count, size_t record_size) {
+        return offset <= size && count <= (size - offset) / record_size;
+    };
+    if (!std::equal(compiled_magic, compiled_magic + 8, h.magic) ||
+        h.version != compiled_version || h.record_sizes != compiled_record_sizes ||
+        !section_ok(h.lights_offset,    h.num_lights,    sizeof(CompiledLight)) ||
+        !section_ok(h.planes_offset,    h.num_planes,    sizeof(CompiledPlane)) ||
+        !section_ok(h.spheres_offset,   h.num_spheres,   sizeof(CompiledSphere)) ||
+        !section_ok(h.cylinders_offset, h.num_cylinders, sizeof(CompiledCylinder)) ||
+        !section_ok(h.meshes_offset,    h.num_meshes,    sizeof(CompiledMesh)))
+        throw std::runtime_error("Incompatible compiled scene " + _filename);
+
+    // copy a section of records (the file offsets need not be aligned)
+    auto records = [data](uint64_t offset, uint64_t count, void *dest, size_t record_size) {
+        std::copy(data + offset, data + offset + count * record_size, static_cast<char *>(dest));
+    };
+
+    camera.eye    = h.eye;
+    camera.center = h.center;
+    camera.up     = h.up;
+    camera.fovy   = h.fovy;
+    camera.width  = h.width;
+    camera.height = h.height;
+    camera.init();
+    max_depth  = h.max_depth;
+    background = h.background;
+    ambience   = h.ambience;
+
+    std::vector<CompiledLight> light_records(h.num_lights);
+    records(h.lights_offset, h.num_lights, light_records.data(), sizeof(CompiledLight));
+    for (const CompiledLight &r : light_records)
+    {
+        if (r.shape < Light::POINT || r.shape > Light::SPHERE)
+            throw std::runtime_error("Invalid light in compiled scene " + _filename);
+        lights.emplace_back(r.position, r.color);
+        lights.back().shape  = Light::Shape(r.shape);
+        lights.back().edge_u = r.edge_u;
+        lights.back().edge_v = r.edge_v;
+        lights.back().radius = r.radius;
+    }
+
+    std::vector<CompiledPlane> plane_records(h.num_planes);
+    records(h.planes_offset, h.num_planes, plane_records.data(), sizeof(CompiledPlane));
+    for (const CompiledPlane &r : plane_records)
+    {
+        planes.emplace_back(r.center, r.normal);
+        planes.back().material = r.material;
+    }
+
+    std::vector<CompiledSphere> sphere_records(h.num_spheres);
+    records(h.spheres_offset, h.num_spheres, sphere_records.data(), sizeof(CompiledSphere));
+    for (const CompiledSphere &r : sphere_records)
+    {
+        spheres.emplace_back(r.center, r.radius);
+        spheres.back().material = r.material;
+    }
+
+    std::vector<CompiledCylinder> cylinder_records(h.num_cylinders);
+    records(h.cylinders_offset, h.num_cylinders, cylinder_records.data(), sizeof(CompiledCylinder));
+    for (const CompiledCylinder &r : cylinder_records)
+    {
+        cylinders.emplace_back(r.center, r.radius, r.axis, r.height);
+        cylinders.back().material = r.material;
+    }
+
+    std::vector<CompiledMesh> mesh_records(h.num_meshes);
+    records(h.meshes_offset, h.num_meshes, mesh_records.data(), sizeof(CompiledMesh));
+    for (const CompiledMesh &r : mesh_records)
+    {
+        if (r.draw_mode != Mesh::FLAT && r.draw_mode != Mesh::PHONG)
+            throw std::runtime_error("Invalid mesh in compiled scene " + _filename);
+        meshes.push_back(arena.create<Mesh>(file, size_t(r.offset), Mesh::Draw_mode(r.draw_mode), r.material));
+    }
+}
+
+
+//=============================================================================
@@ -20,18 +20,14 @@
 
 bool
 Cylinder::
-intersect(const Ray&  _ray,
-          vec3&       _intersection_point,
-          vec3&       _intersection_normal,
-          double&     _intersection_t) const
+intersect(const Ray& _ray, Hit& _hit) const
 {
     /** \todo
      * - compute the first valid intersection `_ray` with the cylinder
      *   (valid means in front of the viewer: t > 0)
-     * - store intersection point in `_intersection_point`
-     * - store ray parameter in `_intersection_t`
-     * - store normal at _intersection_point in `_intersection_normal`.
+     * - store ray parameter in `_hit.t`
      * - return whether there is an intersection with t > 0
+     * (point and normal are computed by surface())
     */
 
     const vec3    &dir = _ray.direction;
@@ -52,7 +48,7 @@ intersect(const Ray&  _ray,
     // solve quadratic
     std::array<double, 2> t;
     size_t nsol = solveQuadratic(A, B, C, t);
-    _intersection_t = NO_INTERSECTION;
+    _hit.t = NO_INTERSECTION;
 
     // max distance to cylinder center
     const double MAX_DIST = sqrt(pow(height/2, 2) + pow(radius, 2));
@@ -62,29 +58,36 @@ intersect(const Ray&  _ray,
 		if (t[i] > 0) {
 			// check hitting actual cylinder
 			if (norm(offset + t[i]*dir) <= MAX_DIST)
-				_intersection_t = std::min(_intersection_t, t[i]);
+				_hit.t = std::min(_hit.t, t[i]);
 		}
 	}
 
-	if (_intersection_t == NO_INTERSECTION) return false;
+	return (_hit.t != NO_INTERSECTION);
+}
+
 
-	// final
-	_intersection_point = origin + _intersection_t*dir;
+//-----------------------------------------------------------------------------
+
+
+void
+Cylinder::
+surface(const Ray& _ray, const Hit& _hit, vec3& _point, vec3& _normal) const
+{
+	const vec3 &dir = _ray.direction;
+	_point = _ray.origin + _hit.t*dir;
 
 	// calculating normal vector trigonometrically
 	const vec3 base = center - axis*height/2;
-	const double base_to_intersection = norm(_intersection_point - base);
+	const double base_to_intersection = norm(_point - base);
 	const double  h = sqrt(pow(base_to_intersection, 2) - pow(radius, 2));
 
 	// intersection point mapped to cylinder axis
 	const vec3 axis_mapping = base + h*axis;
-	const vec3       normal = _intersection_point - axis_mapping;
+	const vec3       normal = _point - axis_mapping;
 
 	//final
 	if (dot(normal, dir) < 0)
-	    _intersection_normal = normalize(normal);
+	    _normal = normalize(normal);
 	else
-	    _intersection_normal = normalize(-normal);
-
-	return true;
+	    _normal = normalize(-normal);
 }
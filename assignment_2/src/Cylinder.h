@@ -17,6 +17,9 @@
 #include "Object.h"
 #include "vec3.h"
 
+#include <cmath>
+#include <algorithm>
+
 
 //== CLASS DEFINITION =========================================================
 
@@ -39,16 +42,26 @@ public:
     Cylinder(std::istream &is) { parse(is); }
 
     /// Compute the intersection of the cylinder with \c _ray. Return whether
-    /// there is an intersection. If there is one, return the intersection data.
-    /// This function overrides Object::intersect().
-	/// \param[in] _ray the ray to intersect the plane with
-	/// \param[out] _intersection_point position of the intersection
-	/// \param[out] _intersection_normal normal vector at the intersection point
-	/// \param[out] _intersection_t ray parameter at the intesection point
-    virtual bool intersect(const Ray&  _ray,
-                           vec3&       _intersection_point,
-                           vec3&       _intersection_normal,
-                           double&     _intersection_t) const override;
+    /// there is an intersection; if there is one, store its ray parameter in
+    /// \c _hit. This function overrides Object::intersect().
+    virtual bool intersect(const Ray& _ray, Hit& _hit) const override;
+
+    /// Compute the point and normal of hit \c _hit of \c _ray.
+    /// This function overrides Object::surface().
+    virtual void surface(const Ray& _ray, const Hit& _hit, vec3& _point, vec3& _normal) const override;
+
+    using Object::intersect;
+
+    /// the box around the open cylinder, i.e., its axis segment and end circles
+    virtual bool bounds(vec3& _min, vec3& _max) const override {
+        for (int i = 0; i < 3; ++i) {
+            const double e = std::fabs(axis[i]) * 0.5 * height +
+                             radius * std::sqrt(std::max(0.0, 1.0 - axis[i]*axis[i]));
+            _min[i] = center[i] - e;
+            _max[i] = center[i] + e;
+        }
+        return true;
+    }
 
     /// parse cylinder from an input stream
     virtual void parse(std::istream &is) override {
@@ -57,6 +70,9 @@ public:
     }
 
 private:
+    /// compiled scene files store the parameters byte-wise
+    friend class Scene;
+
 	/// center position
     vec3 center;
 
@@ -0,0 +1,67 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+
+//== INCLUDES =================================================================
+
+#include "vec3.h"
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class Frustum Frustum.h
+/// An infinite pyramid bounded by four planes through its apex, e.g. the
+/// volume covered by the primary rays of an image tile.
+struct Frustum
+{
+    /// the common point of the four planes (the camera's eye)
+    vec3 apex;
+
+    /// inward pointing plane normals
+    vec3 normal[4];
+
+    /// Construct the frustum with apex \c _apex whose edges point into the
+    /// directions \c _d[0], ..., \c _d[3], given in circular order.
+    Frustum(const vec3& _apex, const vec3 _d[4]) : apex(_apex)
+    {
+        const vec3 mid = _d[0] + _d[1] + _d[2] + _d[3];
+        for (int i = 0; i < 4; ++i)
+        {
+            normal[i] = cross(_d[i], _d[(i+1) % 4]);
+            if (dot(normal[i], mid) < 0) normal[i] = -normal[i];
+        }
+    }
+
+    /// Conservatively test whether the box [_min, _max] overlaps the frustum:
+    /// false is only returned if the box lies completely outside one plane.
+    bool intersects(const vec3& _min, const vec3& _max) const
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            // the box corner farthest inside this plane
+            const vec3& n = normal[i];
+            const vec3 p(n[0] >= 0 ? _max[0] : _min[0],
+                         n[1] >= 0 ? _max[1] : _min[1],
+                         n[2] >= 0 ? _max[2] : _min[2]);
+            const vec3 d = p - apex;
+            if (dot(n, d) < -1e-9 * norm(n) * norm(d)) return false;
+        }
+        return true;
+    }
+};
+
+
+//=============================================================================
+#endif // FRUSTUM_H defined
+//=============================================================================
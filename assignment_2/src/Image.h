@@ -59,6 +59,12 @@ public:
         return height_;
     }
 
+    /// Returns the memory used by the pixels in bytes.
+    size_t memory() const
+    {
+        return pixels_.capacity() * sizeof(vec3);
+    }
+
     /// Read/write access to pixel (_x,_y). Use this to set the color by
     /// image(x,y) = color;
     vec3& operator()(unsigned int _x, unsigned int _y)
@@ -0,0 +1,51 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef JSONSTRING_H
+#define JSONSTRING_H
+
+
+//== INCLUDES =================================================================
+
+#include <string>
+#include <cstdio>
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+/// \c _s as a JSON string literal: quotes and backslashes are escaped with a
+/// backslash, control characters as \\u00XX. Other bytes, e.g. UTF-8 of file
+/// names, are copied unchanged.
+inline std::string json_string(const std::string& _s)
+{
+    std::string result = "\"";
+    for (char c : _s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+            result += escaped;
+        }
+        else result += c;
+    }
+    return result + "\"";
+}
+
+
+//=============================================================================
+#endif // JSONSTRING_H defined
+//=============================================================================
@@ -15,21 +15,81 @@
 //== INCLUDES =================================================================
 
 #include "vec3.h"
+#include <cmath>
 
 
 //== CLASS DEFINITION =========================================================
 
 /// \class Light Light.h
-/// The class represents a light source and stores position and color.
+/// The class represents a light source and stores position and color. Area
+/// lights additionally have a shape around their position, a rectangle or a
+/// sphere, whose points are sampled for soft shadows.
 struct Light
 {
+    /// shape of a light source
+    enum Shape { POINT, RECTANGLE, SPHERE };
+
+    /// Parse a point light: position and color
     Light(std::istream &is) { is >> position >> color; }
 
-    /// position of the light source
+    /// Parse an area light: a RECTANGLE by its center, two edge vectors and
+    /// color, a SPHERE by its center, radius and color
+    Light(std::istream &is, Shape _shape) : shape(_shape)
+    {
+        is >> position;
+        if (shape == RECTANGLE) is >> edge_u >> edge_v;
+        else if (shape == SPHERE) is >> radius;
+        is >> color;
+    }
+
+    /// Construct a light from its position and color
+    Light(const vec3 &_position, const vec3 &_color) : position(_position), color(_color) {}
+
+    /// The point of the light for the sample (\c _s, \c _t) in [0,1)^2 as
+    /// seen from \c _point. Spheres are sampled on the disk facing the point,
+    /// which they cover in its view. Strata of (s,t) map to strata of the
+    /// rectangle or disk.
+    vec3 sample(const vec3 &_point, double _s, double _t) const
+    {
+        if (shape == RECTANGLE)
+            return position + (_s - 0.5) * edge_u + (_t - 0.5) * edge_v;
+        if (shape != SPHERE)
+            return position;
+
+        // no disk facing a point at the center
+        const vec3 d = position - _point;
+        const double distance = norm(d);
+        if (distance < 1e-10)
+            return position;
+
+        // concentric map of the square onto the unit disk (Shirley and Chiu)
+        const double a = 2.0 * _s - 1.0, b = 2.0 * _t - 1.0;
+        double r, phi;
+        if (a == 0.0 && b == 0.0) { r = 0.0; phi = 0.0; }
+        else if (std::fabs(a) > std::fabs(b)) { r = a; phi = M_PI / 4.0 * (b / a); }
+        else { r = b; phi = M_PI / 2.0 - M_PI / 4.0 * (a / b); }
+
+        // orthonormal frame of the disk perpendicular to the view direction
+        const vec3 w = d / distance;
+        const vec3 u = normalize(std::fabs(w[0]) > 0.5 ? cross(w, vec3(0, 1, 0)) : cross(w, vec3(1, 0, 0)));
+        const vec3 v = cross(w, u);
+        return position + (radius * r) * (std::cos(phi) * u + std::sin(phi) * v);
+    }
+
+    /// position of the light source (center of an area light)
     vec3 position;
 
     /// color of the light source
     vec3 color;
+
+    /// shape of the light source
+    Shape shape = POINT;
+
+    /// edges of a rectangular light, centered at its position
+    vec3 edge_u = vec3(0.0), edge_v = vec3(0.0);
+
+    /// radius of a spherical light
+    double radius = 0.0;
 };
 
 
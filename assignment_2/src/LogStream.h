@@ -0,0 +1,64 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef LOGSTREAM_H
+#define LOGSTREAM_H
+
+
+//== INCLUDES =================================================================
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class LogCapture LogStream.h
+/// Collects the progress messages (see log_stream()) of the thread that
+/// creates it until it is destroyed, e.g. while a scene is loaded in the
+/// background so that its messages do not interleave with those of a render.
+class LogCapture
+{
+public:
+    LogCapture() : previous_(current()) { current() = &buffer_; }
+    ~LogCapture() { current() = previous_; }
+
+    LogCapture(const LogCapture&) = delete;
+    LogCapture& operator=(const LogCapture&) = delete;
+
+    /// the messages collected so far
+    std::string str() const { return buffer_.str(); }
+
+    /// the progress stream of the calling thread
+    static std::ostream*& current()
+    {
+        thread_local std::ostream* stream = &std::cout;
+        return stream;
+    }
+
+private:
+    std::ostream*      previous_;
+    std::ostringstream buffer_;
+};
+
+
+/// Stream for progress messages of the calling thread: std::cout, unless a
+/// LogCapture on this thread collects them
+inline std::ostream& log_stream()
+{
+    return *LogCapture::current();
+}
+
+
+//=============================================================================
+#endif // LOGSTREAM_H defined
+//=============================================================================
@@ -0,0 +1,203 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+
+//== INCLUDES =================================================================
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class MappedFile MappedFile.h
+/// This class maps a file read-only into memory. Pages are loaded by the
+/// operating system only when they are touched, so files larger than the
+/// main memory can be accessed as long as the working set fits.
+class MappedFile
+{
+public:
+
+    /// Construct an empty mapping
+    MappedFile() {}
+
+    /// Map the file \c _filename, throw std::runtime_error on failure
+    explicit MappedFile(const std::string& _filename) { open(_filename); }
+
+    /// Unmap the file
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// Map the file \c _filename. Access is expected to be random (e.g. BVH
+    /// traversal), so read-ahead is disabled.
+    void open(const std::string& _filename)
+    {
+        close();
+#ifdef _WIN32
+        throw std::runtime_error("Memory-mapped files are not supported on this platform: " + _filename);
+#else
+        int fd = ::open(_filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open file " + _filename);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Cannot map empty file " + _filename);
+        }
+
+        void *data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("Cannot map file " + _filename);
+
+        madvise(data, size_t(st.st_size), MADV_RANDOM);
+        data_ = static_cast<const char *>(data);
+        size_ = size_t(st.st_size);
+#endif
+    }
+
+    /// Unmap the file
+    void close()
+    {
+#ifndef _WIN32
+        if (data_) munmap(const_cast<char *>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    /// Start of the mapped file
+    const char *data() const { return data_; }
+
+    /// Size of the mapped file in bytes
+    size_t size() const { return size_; }
+
+    /// Number of bytes of the mapping that are currently resident in memory
+    size_t resident_bytes() const { return resident_bytes(0, size_); }
+
+    /// Number of bytes of the range [_offset, _offset+_size) of the mapping
+    /// that are currently resident in memory, counted in whole pages
+    size_t resident_bytes(size_t _offset, size_t _size) const
+    {
+#ifdef _WIN32
+        return 0;
+#else
+        if (!data_ || _offset >= size_) return 0;
+        const size_t page  = size_t(sysconf(_SC_PAGESIZE));
+        const size_t begin = _offset / page * page;
+        const size_t end   = std::min(_offset + _size, size_);
+        std::vector<unsigned char> pages((end - begin + page - 1) / page);
+        if (mincore(const_cast<char *>(data_ + begin), end - begin, pages.data()) != 0) return 0;
+        size_t resident = 0;
+        for (unsigned char p : pages) resident += (p & 1);
+        return resident * page;
+#endif
+    }
+
+private:
+
+    /// start of the mapping
+    const char *data_ = nullptr;
+
+    /// length of the mapping in bytes
+    size_t size_ = 0;
+};
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class ScratchArray MappedFile.h
+/// A fixed-size array of trivially copyable elements in an anonymous
+/// temporary file that is mapped read-write. The operating system writes its
+/// pages back to the file when memory runs short, so tools can process
+/// arrays larger than the main memory. The elements start zeroed.
+template <class T>
+class ScratchArray
+{
+public:
+
+    /// Create an array of \c _size elements in a temporary file next to
+    /// \c _path_prefix, throw std::runtime_error on failure
+    ScratchArray(size_t _size, const std::string& _path_prefix) : size_(_size)
+    {
+#ifdef _WIN32
+        throw std::runtime_error("Scratch files are not supported on this platform: " + _path_prefix);
+#else
+        if (!size_) return;
+        std::string name = _path_prefix + ".scratchXXXXXX";
+        int fd = mkstemp(&name[0]);
+        if (fd < 0)
+            throw std::runtime_error("Cannot create scratch file " + name);
+        ::unlink(name.c_str());
+
+        const size_t bytes = size_ * sizeof(T);
+        void *data = MAP_FAILED;
+        if (ftruncate(fd, off_t(bytes)) == 0)
+            data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("Cannot map scratch file " + name);
+        data_ = static_cast<T *>(data);
+#endif
+    }
+
+    /// Unmap and thereby delete the file
+    ~ScratchArray()
+    {
+#ifndef _WIN32
+        if (data_) munmap(data_, size_ * sizeof(T));
+#endif
+    }
+
+    ScratchArray(const ScratchArray&) = delete;
+    ScratchArray& operator=(const ScratchArray&) = delete;
+
+    /// element \c _i
+    T& operator[](size_t _i) { return data_[_i]; }
+
+    /// element \c _i
+    const T& operator[](size_t _i) const { return data_[_i]; }
+
+    /// number of elements
+    size_t size() const { return size_; }
+
+private:
+
+    /// start of the mapping
+    T *data_ = nullptr;
+
+    /// number of elements
+    size_t size_ = 0;
+};
+
+
+//=============================================================================
+#endif // MAPPEDFILE_H defined
+//=============================================================================
@@ -15,6 +15,7 @@
 //== INCLUDES =================================================================
 
 #include "vec3.h"
+#include <cmath>
 
 
 //== CLASS DEFINITION =========================================================
@@ -52,6 +53,64 @@ inline std::istream& operator>>(std::istream& is, Material& m)
 }
 
 
+//-----------------------------------------------------------------------------
+
+
+/// \class MaterialClass Material.h
+/// The terms of the Phong model a material actually uses. It is determined
+/// once per object, so that shading can select a kernel without the unused
+/// terms instead of evaluating them for every shading point. The default
+/// class uses all terms.
+struct MaterialClass
+{
+    /// nonzero diffuse color
+    bool diffuse = true;
+
+    /// nonzero specular color
+    bool specular = true;
+
+    /// nonzero reflectivity
+    bool mirror = true;
+
+    /// shininess is an integer up to MAX_EXPONENT, stored in exponent
+    bool integral_shininess = false;
+    unsigned int exponent = 0;
+
+    /// largest shininess evaluated by repeated squaring instead of pow()
+    static const unsigned int MAX_EXPONENT = 1024;
+};
+
+
+/// classify the terms used by material \c m
+inline MaterialClass classify(const Material& m)
+{
+    auto nonzero = [](const vec3& c) { return c[0] != 0.0 || c[1] != 0.0 || c[2] != 0.0; };
+
+    MaterialClass c;
+    c.diffuse  = nonzero(m.diffuse);
+    c.specular = nonzero(m.specular);
+    c.mirror   = m.mirror != 0.0;
+    c.integral_shininess = m.shininess >= 0.0 && m.shininess <= MaterialClass::MAX_EXPONENT &&
+                           m.shininess == std::floor(m.shininess);
+    c.exponent = c.integral_shininess ? static_cast<unsigned int>(m.shininess) : 0;
+    return c;
+}
+
+
+/// \c x to the power of \c n by repeated squaring
+inline double integer_power(double x, unsigned int n)
+{
+    double result = 1.0;
+    while (n)
+    {
+        if (n & 1) result *= x;
+        x *= x;
+        n >>= 1;
+    }
+    return result;
+}
+
+
 //=============================================================================
 #endif // MATERIAL_H defined
 //=============================================================================
@@ -0,0 +1,174 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef MEMORYREPORT_H
+#define MEMORYREPORT_H
+
+
+//== INCLUDES =================================================================
+
+#include "ResourceUsage.h"
+#include "JsonString.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <iostream>
+#include <iomanip>
+#include <cstddef>
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class MemoryReport MemoryReport.h
+/// Explicit accounting of the memory held by a scene and a render: objects
+/// add the bytes of their arrays per category (e.g. "vertices", "bvh"), and
+/// snapshots record the process' resident set at chosen stages. Bytes are
+/// capacities, i.e., what is actually allocated. Mapped files count with
+/// their resident pages only.
+struct MemoryReport
+{
+    /// bytes of one category held by one object
+    struct Entry
+    {
+        std::string object, category;
+        size_t bytes;
+    };
+
+    /// all entries in the order they were added
+    std::vector<Entry> entries;
+
+    /// resident set at named stages, e.g. "load" and "render"
+    std::vector<std::pair<std::string, ResourceUsage>> snapshots;
+
+    /// Account \c _bytes of category \c _category to \c _object (empty
+    /// entries are skipped)
+    void add(const std::string& _object, const std::string& _category, size_t _bytes)
+    {
+        if (_bytes) entries.push_back(Entry{ _object, _category, _bytes });
+    }
+
+    /// Record the resident set of the process at stage \c _stage
+    void snapshot(const std::string& _stage)
+    {
+        snapshots.emplace_back(_stage, ResourceUsage::now());
+    }
+
+    /// sum of all entries
+    size_t total() const
+    {
+        size_t sum = 0;
+        for (const Entry& e : entries) sum += e.bytes;
+        return sum;
+    }
+
+    /// bytes per category
+    std::map<std::string, size_t> categories() const
+    {
+        std::map<std::string, size_t> sums;
+        for (const Entry& e : entries) sums[e.category] += e.bytes;
+        return sums;
+    }
+
+    /// objects in the order of their first entry, with their entries
+    std::vector<std::pair<std::string, std::vector<const Entry*>>> objects() const
+    {
+        std::vector<std::pair<std::string, std::vector<const Entry*>>> result;
+        std::map<std::string, size_t> index;
+        for (const Entry& e : entries)
+        {
+            auto it = index.find(e.object);
+            if (it == index.end())
+            {
+                it = index.insert(std::make_pair(e.object, result.size())).first;
+                result.emplace_back(e.object, std::vector<const Entry*>());
+            }
+            result[it->second].second.push_back(&e);
+        }
+        return result;
+    }
+
+    /// Print the breakdown per category and per object in MB
+    void print(std::ostream& _os) const
+    {
+        auto mb = [](size_t _bytes) { return _bytes / (1024.0*1024.0); };
+        const std::ios::fmtflags flags = _os.flags();
+        const std::streamsize precision = _os.precision();
+        _os << std::fixed << std::setprecision(3);
+
+        _os << "Memory by category (MB):\n";
+        for (const auto& c : categories())
+            _os << "  " << std::left << std::setw(16) << c.first << std::right << std::setw(10) << mb(c.second) << "\n";
+        _os << "  " << std::left << std::setw(16) << "total" << std::right << std::setw(10) << mb(total()) << "\n";
+
+        _os << "Memory by object (MB):\n";
+        for (const auto& o : objects())
+        {
+            size_t sum = 0;
+            for (const Entry* e : o.second) sum += e->bytes;
+            _os << "  " << o.first << ": " << mb(sum) << " (";
+            for (size_t i = 0; i < o.second.size(); ++i)
+                _os << (i ? ", " : "") << o.second[i]->category << ' ' << mb(o.second[i]->bytes);
+            _os << ")\n";
+        }
+
+        for (const auto& s : snapshots)
+            _os << "  after " << s.first << ": " << s.second << "\n";
+
+        _os.flags(flags);
+        _os.precision(precision);
+    }
+
+    /// Write the report as a JSON object with the members "total_bytes",
+    /// "categories", "objects" and "snapshots"
+    void write_json(std::ostream& _os) const
+    {
+        _os << "{\n  \"total_bytes\": " << total() << ",\n  \"categories\": {";
+        bool first = true;
+        for (const auto& c : categories())
+        {
+            _os << (first ? "\n" : ",\n") << "    " << json_string(c.first) << ": " << c.second;
+            first = false;
+        }
+        _os << "\n  },\n  \"objects\": [";
+
+        first = true;
+        for (const auto& o : objects())
+        {
+            size_t sum = 0;
+            for (const Entry* e : o.second) sum += e->bytes;
+            _os << (first ? "\n" : ",\n") << "    { \"name\": " << json_string(o.first)
+                << ", \"bytes\": " << sum << ", \"categories\": {";
+            for (size_t i = 0; i < o.second.size(); ++i)
+                _os << (i ? ", " : " ") << json_string(o.second[i]->category) << ": " << o.second[i]->bytes;
+            _os << " } }";
+            first = false;
+        }
+        _os << "\n  ],\n  \"snapshots\": [";
+
+        first = true;
+        for (const auto& s : snapshots)
+        {
+            _os << (first ? "\n" : ",\n") << "    { \"stage\": " << json_string(s.first)
+                << ", \"rss\": " << s.second.rss << ", \"peak_rss\": " << s.second.peak_rss
+                << ", \"minor_faults\": " << s.second.minor_faults
+                << ", \"major_faults\": " << s.second.major_faults << " }";
+            first = false;
+        }
+        _os << "\n  ]\n}\n";
+    }
+};
+
+
+//=============================================================================
+#endif // MEMORYREPORT_H defined
+//=============================================================================
@@ -11,22 +11,81 @@
 //== INCLUDES =================================================================
 
 #include "Mesh.h"
+#include "Profiler.h"
+#include "LogStream.h"
 #include <fstream>
 #include <string>
 #include <stdexcept>
 #include <limits>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <type_traits>
+#include <functional>
+#include <memory>
+
+#ifndef _WIN32
+#  include <sys/stat.h>
+#  include <dirent.h>
+#  include <utime.h>
+#endif
+
+#if HAS_TBB
+#include <tbb/tbb.h>
+#include <tbb/parallel_for.h>
+#endif
 
 
 //== IMPLEMENTATION ===========================================================
 
 
-Mesh::Mesh(std::istream &is, const std::string &scenePath)
+// Reorder _array such that position i holds the former element _order[i].
+template <class T>
+static void reorder(std::vector<T>& _array, const std::vector<uint32_t>& _order)
+{
+    std::vector<T> sorted(_array.size());
+    for (size_t i = 0; i < _order.size(); ++i)
+        sorted[i] = _array[_order[i]];
+    _array.swap(sorted);
+}
+
+
+// Call _f(i) for i = 0, ..., _n-1, in parallel if possible. We use TBB if
+// available and try OpenMP otherwise (see Scene::render()).
+template <class Function>
+static void parallel_for(int _n, Function _f)
+{
+#if HAS_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, _n), [&_f](const tbb::blocked_range<int> &range) {
+        for (int i = range.begin(); i < range.end(); ++i)
+            _f(i);
+    });
+#else
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+    for (int i = 0; i < _n; ++i)
+        _f(i);
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+Mesh::Mesh(std::istream &is, const std::string &scenePath, Storage _storage, bool _lazy_bvh)
 {
+    storage_  = _storage;
+    lazy_bvh_ = _lazy_bvh;
+
     std::string meshFile, mode;
     is >> meshFile;
 
     // load mesh from file
-    read(scenePath.substr(0, scenePath.find_last_of('/') + 1) + meshFile);
+    read(mesh_path(scenePath, meshFile));
 
     is >> mode;
     if      (mode ==  "FLAT") draw_mode_ = FLAT;
@@ -37,11 +96,76 @@ Mesh::Mesh(std::istream &is, const std::string &scenePath)
 }
 
 
+std::string Mesh::mesh_path(const std::string &_scenePath, const std::string &_meshFile)
+{
+    // absolute paths are used as they are, e.g. for packed meshes on a separate disk
+    if (!_meshFile.empty() && _meshFile[0] == '/')
+        return _meshFile;
+    return _scenePath.substr(0, _scenePath.find_last_of('/') + 1) + _meshFile;
+}
+
+
+Mesh::Mesh(const std::string &_filename, Draw_mode _mode)
+: draw_mode_(_mode)
+{
+    if (!read(_filename))
+        throw std::runtime_error("Cannot read mesh " + _filename);
+}
+
+
+Mesh::Mesh(std::shared_ptr<const MappedFile> _file, size_t _offset,
+           Draw_mode _mode, const Material &_material)
+: draw_mode_(_mode)
+{
+    material = _material;
+    if (!attach_packed(_file, _offset, "mesh at offset " + std::to_string(_offset)))
+        throw std::runtime_error("Invalid packed mesh at offset " + std::to_string(_offset));
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+// Header of a packed mesh file. The sections follow at page-aligned offsets,
+// so that they can be used in place after mapping the file.
+struct PackedMeshHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t vertex_size;
+    uint32_t triangle_size;
+    uint32_t node_size;
+    uint64_t num_vertices;
+    uint64_t num_triangles;
+    uint64_t num_nodes;
+    uint64_t vertex_offset;
+    uint64_t triangle_offset;
+    uint64_t node_offset;
+    double   bb_min[3];
+    double   bb_max[3];
+};
+
+static const char     packed_magic[8] = { 'R', 'T', 'M', 'E', 'S', 'H', 0, 0 };
+static const uint32_t packed_version  = 1;
+static const uint64_t packed_alignment = Mesh::PACKED_ALIGNMENT;
+
+
 //-----------------------------------------------------------------------------
 
 
 bool Mesh::read(const std::string &_filename)
 {
+    ProfileScope scope("load mesh", _filename);
+    name_ = _filename;
+
+    // packed meshes are mapped instead of read
+    if (_filename.size() > 4 && _filename.compare(_filename.size() - 4, 4, ".rtm") == 0)
+    {
+        if (!read_packed(_filename))
+            throw std::runtime_error("Cannot map packed mesh " + _filename);
+        return true;
+    }
+
     // read a mesh in OFF format
 
 
@@ -64,42 +188,553 @@ bool Mesh::read(const std::string &_filename)
         return false;
     }
     ifs >> nV >> nF >> dummy;
-    std::cout << "\n  read " << _filename << ": " << nV << " vertices, " << nF << " triangles";
+    log_stream() << "\n  read " << _filename << ": " << nV << " vertices, " << nF << " triangles";
 
 
-    // read vertices
-    Vertex v;
-    vertices_.clear();
-    vertices_.reserve(nV);
-    for (i=0; i<nV; ++i)
     {
-        ifs >> v.position;
-        vertices_.push_back(v);
+        ProfileScope parse("read OFF", _filename);
+
+        // read vertices
+        Vertex v;
+        vertices_.clear();
+        vertices_.reserve(nV);
+        for (i=0; i<nV; ++i)
+        {
+            ifs >> v.position;
+            vertices_.push_back(v);
+        }
+
+
+        // read triangles
+        Triangle t;
+        triangles_.clear();
+        triangles_.reserve(nF);
+        for (i=0; i<nF; ++i)
+        {
+            ifs >> dummy >> t.i0 >> t.i1 >> t.i2;
+            triangles_.push_back(t);
+        }
+
+
+        // close file
+        ifs.close();
+    }
+
+
+    // compute face and vertex normals
+    compute_normals();
+
+    // compute bounding box
+    compute_bounding_box();
+
+    // convert to compact storage before building the BVH, so that the BVH
+    // bounds the positions that are actually intersected
+    if (storage_ != FULL)
+        compress();
+
+    vertex_data_   = vertices_.data();
+    triangle_data_ = triangles_.data();
+    num_vertices_  = nV;
+    num_triangles_ = nF;
+
+    // build acceleration structure
+    build_bvh();
+
+
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool Mesh::read_packed(const std::string &_filename)
+{
+    std::shared_ptr<const MappedFile> file;
+    try
+    {
+        file = std::make_shared<MappedFile>(_filename);
     }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << "\n";
+        return false;
+    }
+
+    return attach_packed(file, 0, _filename);
+}
 
 
-    // read triangles
-    Triangle t;
+//-----------------------------------------------------------------------------
+
+
+bool Mesh::attach_packed(std::shared_ptr<const MappedFile> _file, size_t _offset,
+                         const std::string &_name)
+{
+    name_ = _name;
+
+    if (storage_ != FULL)
+    {
+        std::cerr << "\n  packed meshes always use full storage";
+        storage_ = FULL;
+    }
+
+    PackedMeshHeader h;
+    if (_offset % packed_alignment || _offset + sizeof(h) > _file->size())
+    {
+        std::cerr << "No packed mesh: " << _name << "\n";
+        return false;
+    }
+    const char *data = _file->data() + _offset;
+    const size_t size = _file->size() - _offset;
+    std::copy(data, data + sizeof(h), reinterpret_cast<char *>(&h));
+
+    if (!std::equal(packed_magic, packed_magic + 8, h.magic) || h.version != packed_version ||
+        h.vertex_size != sizeof(Vertex) || h.triangle_size != sizeof(Triangle) ||
+        h.node_size != sizeof(BVH::Node) ||
+        h.num_vertices  > size / sizeof(Vertex) || h.num_triangles > size / sizeof(Triangle) ||
+        h.num_nodes     > size / sizeof(BVH::Node) ||
+        h.vertex_offset   + h.num_vertices  * sizeof(Vertex)    > size ||
+        h.triangle_offset + h.num_triangles * sizeof(Triangle)  > size ||
+        h.node_offset     + h.num_nodes     * sizeof(BVH::Node) > size)
+    {
+        std::cerr << "Incompatible packed mesh " << _name << "\n";
+        return false;
+    }
+
+    // a corrupt or truncated file must not lead traversal out of the
+    // sections, so all references are checked once (sequentially)
+    const Triangle  *triangles = reinterpret_cast<const Triangle *>(data + h.triangle_offset);
+    const BVH::Node *nodes     = reinterpret_cast<const BVH::Node *>(data + h.node_offset);
+    for (uint64_t f = 0; f < h.num_triangles; ++f)
+    {
+        const Triangle &t = triangles[f];
+        if (t.i0 < 0 || t.i1 < 0 || t.i2 < 0 || uint64_t(t.i0) >= h.num_vertices ||
+            uint64_t(t.i1) >= h.num_vertices || uint64_t(t.i2) >= h.num_vertices)
+            throw std::runtime_error("Corrupt packed mesh " + _name + ": vertex index out of range");
+    }
+    if (!BVH::valid_nodes(nodes, h.num_nodes, h.num_triangles))
+        throw std::runtime_error("Corrupt packed mesh " + _name + ": BVH node out of range");
+    if (h.num_triangles && !h.num_nodes)
+        throw std::runtime_error("Corrupt packed mesh " + _name + ": BVH missing");
+
+    mapped_        = _file;
+    mapped_offset_ = _offset;
+    mapped_size_   = size_t(h.vertex_offset + h.num_vertices * sizeof(Vertex));
+
+    vertices_.clear();
     triangles_.clear();
-    triangles_.reserve(nF);
-    for (i=0; i<nF; ++i)
+    num_vertices_  = h.num_vertices;
+    num_triangles_ = h.num_triangles;
+    vertex_data_   = reinterpret_cast<const Vertex *>(data + h.vertex_offset);
+    triangle_data_ = reinterpret_cast<const Triangle *>(data + h.triangle_offset);
+    bvh_.attach(reinterpret_cast<const BVH::Node *>(data + h.node_offset), h.num_nodes);
+    bb_min_ = vec3(h.bb_min[0], h.bb_min[1], h.bb_min[2]);
+    bb_max_ = vec3(h.bb_max[0], h.bb_max[1], h.bb_max[2]);
+
+    log_stream() << "\n  map " << _name << ": " << num_vertices_ << " vertices, "
+              << num_triangles_ << " triangles (" << mapped_size_ / (1024.0*1024.0) << " MB)";
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool Mesh::write_packed(const std::string &_filename) const
+{
+    std::ofstream ofs(_filename, std::ofstream::binary);
+    if (!ofs)
+    {
+        std::cerr << "Can't open " << _filename << "\n";
+        return false;
+    }
+    return write_packed(ofs);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool Mesh::write_packed(std::ostream &_os) const
+{
+    static_assert(std::is_trivially_copyable<Vertex>::value &&
+                  std::is_trivially_copyable<Triangle>::value &&
+                  std::is_trivially_copyable<BVH::Node>::value,
+                  "packed meshes are written and mapped byte-wise");
+
+    if (storage_ != FULL)
+    {
+        std::cerr << "Packed meshes require full storage\n";
+        return false;
+    }
+    if (bvh_.lazy())
+    {
+        std::cerr << "Packed meshes require an eagerly built BVH\n";
+        return false;
+    }
+
+    const uint64_t start = uint64_t(_os.tellp());
+    if (start % packed_alignment)
+    {
+        std::cerr << "Packed meshes have to start at a page boundary\n";
+        return false;
+    }
+
+    // renumber vertices in order of their first use by the sorted triangles
+    const int unused = -1;
+    std::vector<int> new_index(num_vertices_, unused);
+    std::vector<Vertex>   vertices;
+    std::vector<Triangle> triangles(triangle_data_, triangle_data_ + num_triangles_);
+    vertices.reserve(num_vertices_);
+    for (Triangle &t : triangles)
+    {
+        for (int *i : { &t.i0, &t.i1, &t.i2 })
+        {
+            if (new_index[*i] == unused)
+            {
+                new_index[*i] = int(vertices.size());
+                vertices.push_back(vertex_data_[*i]);
+            }
+            *i = new_index[*i];
+        }
+    }
+
+    auto align = [](uint64_t offset) {
+        return (offset + packed_alignment - 1) / packed_alignment * packed_alignment;
+    };
+
+    PackedMeshHeader h = {};
+    std::copy(packed_magic, packed_magic + 8, h.magic);
+    h.version         = packed_version;
+    h.vertex_size     = sizeof(Vertex);
+    h.triangle_size   = sizeof(Triangle);
+    h.node_size       = sizeof(BVH::Node);
+    h.num_vertices    = vertices.size();
+    h.num_triangles   = triangles.size();
+    h.num_nodes       = bvh_.num_nodes();
+    h.node_offset     = align(sizeof(h));
+    h.triangle_offset = align(h.node_offset + h.num_nodes * sizeof(BVH::Node));
+    h.vertex_offset   = align(h.triangle_offset + h.num_triangles * sizeof(Triangle));
+    for (int i = 0; i < 3; ++i)
+    {
+        h.bb_min[i] = bb_min_[i];
+        h.bb_max[i] = bb_max_[i];
+    }
+
+    auto write_section = [&_os, start](uint64_t offset, const void *data, size_t bytes) {
+        while (uint64_t(_os.tellp()) < start + offset) _os.put(0);
+        _os.write(static_cast<const char *>(data), bytes);
+    };
+    write_section(0, &h, sizeof(h));
+    write_section(h.node_offset, bvh_.nodes(), h.num_nodes * sizeof(BVH::Node));
+    write_section(h.triangle_offset, triangles.data(), triangles.size() * sizeof(Triangle));
+    write_section(h.vertex_offset, vertices.data(), vertices.size() * sizeof(Vertex));
+
+    return bool(_os);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void angleWeights(const vec3 &p0, const vec3 &p1, const vec3 &p2,
+                  double &w0, double &w1, double &w2);
+
+
+bool Mesh::pack(const std::string &_off_file, const std::string &_packed_file, size_t _chunk_size)
+{
+    static_assert(std::is_trivially_copyable<Vertex>::value &&
+                  std::is_trivially_copyable<Triangle>::value,
+                  "packed meshes are written byte-wise");
+
+    std::ifstream ifs(_off_file);
+    if (!ifs)
+    {
+        std::cerr << "Can't open " << _off_file << "\n";
+        return false;
+    }
+    std::string s;
+    uint64_t nV, nF, dummy;
+    ifs >> s;
+    if (s != "OFF" || !(ifs >> nV >> nF >> dummy))
+    {
+        std::cerr << "No OFF file\n";
+        return false;
+    }
+    if (nF >= (1u << 27) - 1 || nV > uint64_t(std::numeric_limits<int>::max()))
+    {
+        std::cerr << "Mesh too large for the packed format\n";
+        return false;
+    }
+    log_stream() << "\n  read " << _off_file << ": " << nV << " vertices, " << nF << " triangles" << std::flush;
+
+    // vertices, with the mesh's bounding box
+    ScratchArray<vec3> positions(nV, _packed_file);
+    vec3 bb_min(std::numeric_limits<double>::max());
+    vec3 bb_max(std::numeric_limits<double>::lowest());
+    for (uint64_t v = 0; v < nV; ++v)
+    {
+        ifs >> positions[v];
+        bb_min = min(bb_min, positions[v]);
+        bb_max = max(bb_max, positions[v]);
+    }
+
+    // Triangles with their normals. Vertex normals are accumulated in
+    // triangle order, like compute_normals() does. Each triangle's centroid
+    // falls into a cell of a 64^3 grid, numbered in Morton order so that
+    // consecutive cells are close.
+    const int grid = 64;
+    auto cell_of = [&](const vec3 &_c) {
+        uint32_t cell = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            const double extent = bb_max[i] - bb_min[i];
+            const uint32_t k = extent > 0.0 ? uint32_t(std::min(grid - 1.0, grid * (_c[i] - bb_min[i]) / extent)) : 0;
+            for (int bit = 0; bit < 6; ++bit)
+                cell |= ((k >> bit) & 1u) << (3 * bit + i);
+        }
+        return cell;
+    };
+    ScratchArray<Triangle> triangles(nF, _packed_file);
+    ScratchArray<vec3>     normals(nV, _packed_file);
+    ScratchArray<uint32_t> cells(nF, _packed_file);
+    std::vector<uint64_t>  cell_count(grid * grid * grid, 0);
+    for (uint64_t f = 0; f < nF; ++f)
     {
+        Triangle t;
         ifs >> dummy >> t.i0 >> t.i1 >> t.i2;
-        triangles_.push_back(t);
+        if (!ifs || t.i0 < 0 || t.i1 < 0 || t.i2 < 0 ||
+            uint64_t(t.i0) >= nV || uint64_t(t.i1) >= nV || uint64_t(t.i2) >= nV)
+        {
+            std::cerr << "\nInvalid triangle " << f << " in " << _off_file << "\n";
+            return false;
+        }
+        const vec3 p0 = positions[t.i0], p1 = positions[t.i1], p2 = positions[t.i2];
+        t.normal = normalize(cross(p1-p0, p2-p0));
+        triangles[f] = t;
+
+        double w0, w1, w2;
+        angleWeights(p0, p1, p2, w0, w1, w2);
+        normals[t.i0] += w0 * t.normal;
+        normals[t.i1] += w1 * t.normal;
+        normals[t.i2] += w2 * t.normal;
+
+        cells[f] = cell_of(0.5 * (min(p0, min(p1, p2)) + max(p0, max(p1, p2))));
+        ++cell_count[cells[f]];
     }
 
+    // consecutive cells form chunks of at most _chunk_size triangles (unless
+    // a single cell holds more); the triangles are sorted by chunk
+    std::vector<uint32_t> chunk_of_cell(cell_count.size());
+    std::vector<uint64_t> chunk_begin(1, 0);
+    uint64_t filled = 0;
+    for (size_t c = 0; c < cell_count.size(); ++c)
+    {
+        if (filled && filled + cell_count[c] > _chunk_size)
+        {
+            chunk_begin.push_back(chunk_begin.back() + filled);
+            filled = 0;
+        }
+        chunk_of_cell[c] = uint32_t(chunk_begin.size() - 1);
+        filled += cell_count[c];
+    }
+    chunk_begin.push_back(nF);
+    const size_t num_chunks = chunk_begin.size() - 1;
 
-    // close file
-    ifs.close();
+    ScratchArray<uint32_t> sorted(nF, _packed_file);
+    {
+        std::vector<uint64_t> fill(chunk_begin.begin(), chunk_begin.end() - 1);
+        for (uint64_t f = 0; f < nF; ++f)
+            sorted[fill[chunk_of_cell[cells[f]]]++] = uint32_t(f);
+    }
 
+    // Chunks become the children of a 4-ary tree of top nodes, whose size
+    // only depends on the number of chunks. Chunk nodes follow the top nodes.
+    std::function<size_t(size_t, size_t)> top_nodes = [&](size_t _begin, size_t _end) -> size_t {
+        if (_end - _begin <= size_t(BVH::WIDTH)) return 1;
+        size_t count = 1;
+        for (int g = 0; g < BVH::WIDTH; ++g)
+        {
+            const size_t b = _begin + (_end - _begin) * g / BVH::WIDTH;
+            const size_t e = _begin + (_end - _begin) * (g + 1) / BVH::WIDTH;
+            if (e - b > 1) count += top_nodes(b, e);
+        }
+        return count;
+    };
+    const size_t num_top = (num_chunks > 1) ? top_nodes(0, num_chunks) : 0;
 
-    // compute face and vertex normals
-    compute_normals();
+    auto align = [](uint64_t offset) {
+        return (offset + packed_alignment - 1) / packed_alignment * packed_alignment;
+    };
 
-    // compute bounding box
-    compute_bounding_box();
+    // the sections are written sequentially into temporary files (deleted
+    // while open) and assembled at the end, when their sizes are known
+    auto temporary = [&](const std::string &_suffix) {
+        const std::string name = _packed_file + _suffix;
+        std::unique_ptr<std::fstream> file(new std::fstream(name, std::ios::in | std::ios::out |
+                                                                  std::ios::trunc | std::ios::binary));
+        std::remove(name.c_str());
+        return file;
+    };
+    std::unique_ptr<std::fstream> node_file     = temporary(".nodes");
+    std::unique_ptr<std::fstream> triangle_file = temporary(".triangles");
+    std::unique_ptr<std::fstream> vertex_file   = temporary(".vertices");
+    if (!*node_file || !*triangle_file || !*vertex_file)
+    {
+        std::cerr << "Can't create temporary files for " << _packed_file << "\n";
+        return false;
+    }
+
+    // vertices are numbered in order of their first use (plus one, zero
+    // marks unused ones)
+    ScratchArray<int> new_index(nV, _packed_file);
+    uint64_t num_vertices = 0;
+    uint64_t num_nodes    = num_top;
+    std::vector<uint32_t> chunk_root(num_chunks);
+    std::vector<vec3>     chunk_min(num_chunks), chunk_max(num_chunks);
+
+    for (size_t c = 0; c < num_chunks; ++c)
+    {
+        const uint64_t begin = chunk_begin[c], count = chunk_begin[c+1] - begin;
+        std::vector<vec3> tri_min(count), tri_max(count);
+        chunk_min[c] = vec3(std::numeric_limits<double>::max());
+        chunk_max[c] = vec3(std::numeric_limits<double>::lowest());
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            const Triangle &t = triangles[sorted[begin + i]];
+            const vec3 p0 = positions[t.i0], p1 = positions[t.i1], p2 = positions[t.i2];
+            tri_min[i] = min(p0, min(p1, p2));
+            tri_max[i] = max(p0, max(p1, p2));
+            chunk_min[c] = min(chunk_min[c], tri_min[i]);
+            chunk_max[c] = max(chunk_max[c], tri_max[i]);
+        }
+        BVH bvh;
+        const std::vector<uint32_t> order = bvh.build(tri_min, tri_max);
+
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            Triangle t = triangles[sorted[begin + order[i]]];
+            for (int *v : { &t.i0, &t.i1, &t.i2 })
+            {
+                if (!new_index[*v])
+                {
+                    const Vertex vertex = { positions[*v], normalize(normals[*v]) };
+                    vertex_file->write(reinterpret_cast<const char *>(&vertex), sizeof(vertex));
+                    new_index[*v] = int(++num_vertices);
+                }
+                *v = new_index[*v] - 1;
+            }
+            triangle_file->write(reinterpret_cast<const char *>(&t), sizeof(t));
+        }
 
+        // the chunk's nodes, renumbered to their place in the joined tree
+        for (size_t n = 0; n < bvh.num_nodes(); ++n)
+        {
+            BVH::Node node = bvh.nodes()[n];
+            for (uint32_t &child : node.child)
+            {
+                if (child == BVH::EMPTY) continue;
+                if (BVH::is_leaf(child))
+                    child = BVH::LEAF_BIT | uint32_t(begin + BVH::leaf_first(child)) << 4 | BVH::leaf_count(child);
+                else
+                    child += uint32_t(num_nodes);
+            }
+            node_file->write(reinterpret_cast<const char *>(&node), sizeof(node));
+        }
+        chunk_root[c] = uint32_t(num_nodes);
+        num_nodes += bvh.num_nodes();
+    }
 
+    // top nodes in depth-first order, parents before their children
+    std::vector<BVH::Node> top;
+    std::function<void(size_t, size_t, vec3&, vec3&)> build_top =
+        [&](size_t _begin, size_t _end, vec3 &_min, vec3 &_max) {
+        const size_t index = top.size();
+        top.push_back(BVH::Node());
+        uint32_t children[BVH::WIDTH];
+        vec3 c_min[BVH::WIDTH], c_max[BVH::WIDTH];
+        int num_children = 0;
+        for (int g = 0; g < BVH::WIDTH; ++g)
+        {
+            const size_t b = (_end - _begin <= size_t(BVH::WIDTH)) ? _begin + g : _begin + (_end - _begin) * g / BVH::WIDTH;
+            const size_t e = (_end - _begin <= size_t(BVH::WIDTH)) ? b + 1 : _begin + (_end - _begin) * (g + 1) / BVH::WIDTH;
+            if (b >= _end || e <= b) continue;
+            if (e - b == 1)
+            {
+                children[num_children] = chunk_root[b];
+                c_min[num_children] = chunk_min[b];
+                c_max[num_children] = chunk_max[b];
+            }
+            else
+            {
+                children[num_children] = uint32_t(top.size());
+                build_top(b, e, c_min[num_children], c_max[num_children]);
+            }
+            ++num_children;
+        }
+        top[index] = BVH::make_node(children, c_min, c_max, num_children);
+        _min = c_min[0];
+        _max = c_max[0];
+        for (int c = 1; c < num_children; ++c)
+        {
+            _min = min(_min, c_min[c]);
+            _max = max(_max, c_max[c]);
+        }
+    };
+    if (num_top)
+    {
+        vec3 root_min, root_max;
+        build_top(0, num_chunks, root_min, root_max);
+    }
+
+    // header and sections in the layout of write_packed()
+    PackedMeshHeader h = {};
+    std::copy(packed_magic, packed_magic + 8, h.magic);
+    h.version         = packed_version;
+    h.vertex_size     = sizeof(Vertex);
+    h.triangle_size   = sizeof(Triangle);
+    h.node_size       = sizeof(BVH::Node);
+    h.num_vertices    = num_vertices;
+    h.num_triangles   = nF;
+    h.num_nodes       = num_nodes;
+    h.node_offset     = align(sizeof(h));
+    h.triangle_offset = align(h.node_offset + h.num_nodes * sizeof(BVH::Node));
+    h.vertex_offset   = align(h.triangle_offset + h.num_triangles * sizeof(Triangle));
+    for (int i = 0; i < 3; ++i)
+    {
+        h.bb_min[i] = bb_min[i];
+        h.bb_max[i] = bb_max[i];
+    }
+
+    std::ofstream ofs(_packed_file, std::ofstream::binary);
+    if (!ofs)
+    {
+        std::cerr << "Can't open " << _packed_file << "\n";
+        return false;
+    }
+    std::vector<char> buffer(1 << 20);
+    auto append = [&](std::fstream &_section, uint64_t _offset) {
+        while (uint64_t(ofs.tellp()) < _offset) ofs.put(0);
+        _section.flush();
+        _section.seekg(0);
+        while (_section.read(buffer.data(), buffer.size()) || _section.gcount() > 0)
+            ofs.write(buffer.data(), _section.gcount());
+        _section.clear();
+    };
+    ofs.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    while (uint64_t(ofs.tellp()) < h.node_offset) ofs.put(0);
+    ofs.write(reinterpret_cast<const char *>(top.data()), top.size() * sizeof(BVH::Node));
+    append(*node_file,     h.node_offset + num_top * sizeof(BVH::Node));
+    append(*triangle_file, h.triangle_offset);
+    append(*vertex_file,   h.vertex_offset);
+
+    log_stream() << " (" << num_chunks << " chunks, " << num_nodes << " BVH nodes)";
+    if (!ofs || uint64_t(ofs.tellp()) != h.vertex_offset + num_vertices * sizeof(Vertex))
+    {
+        std::cerr << "\nCannot write " << _packed_file << "\n";
+        return false;
+    }
     return true;
 }
 
@@ -128,21 +763,132 @@ void angleWeights(const vec3 &p0, const vec3 &p1, const vec3 &p2,
 
 void Mesh::compute_normals()
 {
-    // compute triangle normals
-    for (Triangle& t: triangles_)
+    ProfileScope scope("normals", name_);
+    const int nF = int(triangles_.size());
+    const int nV = int(vertices_.size());
+
+    // compute triangle normals and the angle weights of their corners
+    std::vector<double> weights(3 * triangles_.size());
+    parallel_for(nF, [&](int f)
     {
+        Triangle& t = triangles_[f];
         const vec3& p0 = vertices_[t.i0].position;
         const vec3& p1 = vertices_[t.i1].position;
         const vec3& p2 = vertices_[t.i2].position;
         t.normal = normalize(cross(p1-p0, p2-p0));
+        angleWeights(p0, p1, p2, weights[3*f], weights[3*f+1], weights[3*f+2]);
+    });
+
+    std::vector<int> first, corners;
+    vertex_corners(first, corners);
+
+    // gather the weighted face normals per vertex: every vertex is written
+    // by exactly one iteration, so no synchronization is needed
+    parallel_for(nV, [&](int v)
+    {
+        vec3 n(0,0,0);
+        for (int c = first[v]; c < first[v+1]; ++c)
+            n += weights[corners[c]] * triangles_[corners[c] / 3].normal;
+        vertices_[v].normal = normalize(n);
+    });
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Mesh::vertex_corners(std::vector<int> &_first, std::vector<int> &_corners) const
+{
+    const int nF = int(triangles_.size());
+    const int nV = int(vertices_.size());
+
+    _first.assign(nV + 1, 0);
+    for (const Triangle& t: triangles_)
+    {
+        ++_first[t.i0 + 1];
+        ++_first[t.i1 + 1];
+        ++_first[t.i2 + 1];
     }
+    for (int v = 0; v < nV; ++v)
+        _first[v + 1] += _first[v];
 
-    // initialize vertex normals to zero
-    for (Vertex& v: vertices_)
+    _corners.resize(3 * triangles_.size());
+    std::vector<int> fill(_first.begin(), _first.end() - 1);
+    for (int f = 0; f < nF; ++f)
     {
-        v.normal = vec3(0,0,0);
+        _corners[fill[triangles_[f].i0]++] = 3*f;
+        _corners[fill[triangles_[f].i1]++] = 3*f + 1;
+        _corners[fill[triangles_[f].i2]++] = 3*f + 2;
     }
+}
 
+
+//-----------------------------------------------------------------------------
+
+
+void Mesh::move_vertices(const std::vector<int> &_vertices, const std::vector<vec3> &_positions)
+{
+    ProfileScope scope("move vertices", name_);
+    if (storage_ != FULL || vertices_.size() != num_vertices_ || bvh_.lazy())
+        throw std::logic_error("Only in-core meshes with full storage and an eager BVH can be deformed");
+
+    // the adjacency refers to the triangles in BVH leaf order
+    if (corner_first_.empty())
+    {
+        vertex_corners(corner_first_, corners_);
+        corner_weights_.resize(3 * triangles_.size());
+        parallel_for(int(triangles_.size()), [&](int f)
+        {
+            const Triangle& t = triangles_[f];
+            angleWeights(vertices_[t.i0].position, vertices_[t.i1].position, vertices_[t.i2].position,
+                         corner_weights_[3*f], corner_weights_[3*f+1], corner_weights_[3*f+2]);
+        });
+    }
+
+    for (size_t i = 0; i < _vertices.size(); ++i)
+        vertices_[_vertices[i]].position = _positions[i];
+
+    // triangles around the moved vertices, and the vertices of these triangles
+    std::vector<int> triangles, vertices;
+    for (int v : _vertices)
+        for (int c = corner_first_[v]; c < corner_first_[v+1]; ++c)
+            triangles.push_back(corners_[c] / 3);
+    std::sort(triangles.begin(), triangles.end());
+    triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+    for (int f : triangles)
+    {
+        vertices.push_back(triangles_[f].i0);
+        vertices.push_back(triangles_[f].i1);
+        vertices.push_back(triangles_[f].i2);
+    }
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+    parallel_for(int(triangles.size()), [&](int i)
+    {
+        const int f = triangles[i];
+        Triangle& t = triangles_[f];
+        const vec3& p0 = vertices_[t.i0].position;
+        const vec3& p1 = vertices_[t.i1].position;
+        const vec3& p2 = vertices_[t.i2].position;
+        t.normal = normalize(cross(p1-p0, p2-p0));
+        angleWeights(p0, p1, p2, corner_weights_[3*f], corner_weights_[3*f+1], corner_weights_[3*f+2]);
+    });
+
+    parallel_for(int(vertices.size()), [&](int i)
+    {
+        const int v = vertices[i];
+        vec3 n(0,0,0);
+        for (int c = corner_first_[v]; c < corner_first_[v+1]; ++c)
+            n += corner_weights_[corners_[c]] * triangles_[corners_[c] / 3].normal;
+        vertices_[v].normal = normalize(n);
+    });
+
+    // refit the hierarchy to the moved triangles
+    compute_bounding_box();
+    std::vector<vec3> tri_min, tri_max;
+    triangle_bounds(tri_min, tri_max);
+    bvh_.refit(tri_min, tri_max);
 }
 
 
@@ -151,13 +897,361 @@ void Mesh::compute_normals()
 
 void Mesh::compute_bounding_box()
 {
+    ProfileScope scope("bounds", name_);
+    // parallel reduction: bound fixed chunks of vertices, then merge the chunks
+    const int num_chunks = 64;
+    const size_t chunk = (vertices_.size() + num_chunks - 1) / num_chunks;
+    std::vector<vec3> chunk_min(num_chunks, vec3(std::numeric_limits<double>::max()));
+    std::vector<vec3> chunk_max(num_chunks, vec3(std::numeric_limits<double>::lowest()));
+
+    parallel_for(num_chunks, [&](int c)
+    {
+        const size_t end = std::min(vertices_.size(), (c + 1) * chunk);
+        for (size_t i = c * chunk; i < end; ++i)
+        {
+            const vec3& p = vertices_[i].position;
+            chunk_min[c] = min(chunk_min[c], p);
+            chunk_max[c] = max(chunk_max[c], p);
+        }
+    });
+
     bb_min_ = vec3(std::numeric_limits<double>::max());
     bb_max_ = vec3(std::numeric_limits<double>::lowest());
+    for (int c = 0; c < num_chunks; ++c)
+    {
+        bb_min_ = min(bb_min_, chunk_min[c]);
+        bb_max_ = max(bb_max_, chunk_max[c]);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+// Directory of the BVH cache: $RAYTRACE_BVH_CACHE if it is set (an empty
+// value disables the cache), otherwise $XDG_CACHE_HOME/raytrace or
+// ~/.cache/raytrace. It is created on first use; "" if that fails.
+static std::string bvh_cache_directory()
+{
+#ifdef _WIN32
+    return "";
+#else
+    std::string dir;
+    if (const char *env = getenv("RAYTRACE_BVH_CACHE"))
+        dir = env;
+    else if (const char *xdg = getenv("XDG_CACHE_HOME"))
+        dir = std::string(xdg) + "/raytrace";
+    else if (const char *home = getenv("HOME"))
+        dir = std::string(home) + "/.cache/raytrace";
+    if (dir.empty()) return dir;
 
-    for (Vertex v: vertices_)
+    // create missing parents, too
+    for (size_t slash = dir.find('/', 1); ; slash = dir.find('/', slash + 1))
     {
-        bb_min_ = min(bb_min_, v.position);
-        bb_max_ = max(bb_max_, v.position);
+        mkdir(dir.substr(0, slash).c_str(), 0755);
+        if (slash == std::string::npos) break;
+    }
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        std::cerr << "\n  BVH cache " << dir << " is not a directory, caching disabled";
+        return "";
+    }
+    return dir;
+#endif
+}
+
+
+std::string Mesh::bvh_cache_file(uint64_t _key)
+{
+    static const std::string dir = bvh_cache_directory();
+    if (dir.empty()) return dir;
+
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bvh", (unsigned long long)_key);
+    return dir + name;
+}
+
+
+// Keep the BVH cache below $RAYTRACE_BVH_CACHE_LIMIT megabytes (default
+// 512, 0 means unlimited) by deleting the least recently used files. Hits
+// touch their file, so modification times order the files by last use.
+// \c _keep, the file just written, is never deleted. Temporary files of
+// BVH::save() older than an hour were left by killed runs and are deleted
+// regardless of the limit.
+static void trim_bvh_cache(const std::string &_keep)
+{
+#ifndef _WIN32
+    uint64_t limit = 512;
+    if (const char *env = getenv("RAYTRACE_BVH_CACHE_LIMIT"))
+        limit = strtoull(env, nullptr, 10);
+    limit <<= 20;
+    const time_t stale = time(nullptr) - 3600;
+
+    const std::string dir = _keep.substr(0, _keep.rfind('/'));
+    DIR *d = opendir(dir.c_str());
+    if (!d) return;
+
+    struct Entry { time_t mtime; uint64_t size; std::string path; };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    while (const dirent *e = readdir(d))
+    {
+        const std::string name = e->d_name;
+        const bool temporary = name.find(".bvh.tmp") != std::string::npos;
+        if (!temporary && (name.size() < 4 || name.compare(name.size() - 4, 4, ".bvh") != 0))
+            continue;
+        const std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        if (temporary)
+        {
+            // a younger one may still be written by another process
+            if (st.st_mtime < stale) remove(path.c_str());
+            continue;
+        }
+        total += uint64_t(st.st_size);
+        if (path != _keep)
+            entries.push_back({ st.st_mtime, uint64_t(st.st_size), path });
+    }
+    closedir(d);
+    if (limit == 0) return;
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) { return a.mtime < b.mtime; });
+    for (const Entry &e : entries)
+    {
+        if (total <= limit) break;
+        if (remove(e.path.c_str()) == 0)
+            total -= e.size;
+    }
+#else
+    (void)_keep;
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Mesh::triangle_bounds(std::vector<vec3> &_tri_min, std::vector<vec3> &_tri_max) const
+{
+    const size_t nF = (storage_ == FULL) ? triangles_.size() : compact_triangles_.size();
+    _tri_min.resize(nF);
+    _tri_max.resize(nF);
+    parallel_for(int(nF), [&](int f)
+    {
+        int i0, i1, i2;
+        triangle_vertices(f, i0, i1, i2);
+        const vec3 p0 = vertex_position(i0);
+        const vec3 p1 = vertex_position(i1);
+        const vec3 p2 = vertex_position(i2);
+        _tri_min[f] = min(p0, min(p1, p2));
+        _tri_max[f] = max(p0, max(p1, p2));
+    });
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Mesh::build_bvh()
+{
+    ProfileScope scope("build BVH", name_);
+    const size_t nF = (storage_ == FULL) ? triangles_.size() : compact_triangles_.size();
+
+    // the triangles stay in place, leaves refer to them through the BVH's order
+    if (lazy_bvh_)
+    {
+        bvh_.build_lazy(nF, [this](std::vector<vec3> &tri_min, std::vector<vec3> &tri_max) {
+            triangle_bounds(tri_min, tri_max);
+        });
+        log_stream() << " (lazy BVH, geometry " << geometry_bytes() / 1024 << " KB)";
+        return;
+    }
+
+    std::vector<vec3> tri_min, tri_max;
+    triangle_bounds(tri_min, tri_max);
+
+    // reuse the hierarchy of an earlier run on the same triangles, or build
+    // and cache it
+    std::vector<uint32_t> order;
+    const uint64_t key = BVH::content_hash(tri_min, tri_max);
+    const std::string cache = bvh_cache_file(key);
+    const bool cached = !cache.empty() && bvh_.load(cache, key, nF, order);
+    if (cached)
+    {
+#ifndef _WIN32
+        utime(cache.c_str(), nullptr);
+#endif
+    }
+    else
+    {
+        order = bvh_.build(tri_min, tri_max);
+        if (!cache.empty())
+        {
+            if (bvh_.save(cache, key, order))
+                trim_bvh_cache(cache);
+            else
+                std::cerr << "\n  cannot write BVH cache " << cache;
+        }
+    }
+
+    // store triangles in leaf order
+    if (storage_ == FULL)
+        reorder(triangles_, order);
+    else
+        reorder(compact_triangles_, order);
+    triangle_data_ = triangles_.data();
+
+    log_stream() << " (" << bvh_.num_nodes() << " BVH nodes, ";
+    if (cached)
+        log_stream() << "cached, ";
+    else
+        log_stream() << bvh_.memory() / 1024 << " KB, ";
+    log_stream() << "geometry " << geometry_bytes() / 1024 << " KB)";
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+// Encode the unit vector \c n with octahedral mapping into two 16 bit values.
+static void encode_octahedral(const vec3& n, uint16_t q[2])
+{
+    const double l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    double x = (l1 > 0) ? n[0] / l1 : 0.0;
+    double y = (l1 > 0) ? n[1] / l1 : 0.0;
+    if (n[2] < 0)
+    {
+        const double ox = x;
+        x = (1.0 - std::fabs(y))  * (ox >= 0 ? 1.0 : -1.0);
+        y = (1.0 - std::fabs(ox)) * (y  >= 0 ? 1.0 : -1.0);
+    }
+    q[0] = uint16_t(std::lround((x * 0.5 + 0.5) * 65535.0));
+    q[1] = uint16_t(std::lround((y * 0.5 + 0.5) * 65535.0));
+}
+
+
+// Decode a unit vector encoded by encode_octahedral().
+static vec3 decode_octahedral(const uint16_t q[2])
+{
+    double x = q[0] / 65535.0 * 2.0 - 1.0;
+    double y = q[1] / 65535.0 * 2.0 - 1.0;
+    const double z = 1.0 - std::fabs(x) - std::fabs(y);
+    if (z < 0)
+    {
+        const double ox = x;
+        x = (1.0 - std::fabs(y))  * (ox >= 0 ? 1.0 : -1.0);
+        y = (1.0 - std::fabs(ox)) * (y  >= 0 ? 1.0 : -1.0);
+    }
+    return normalize(vec3(x, y, z));
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Mesh::compress()
+{
+    ProfileScope scope("compress", name_);
+    const size_t nV = vertices_.size();
+
+    if (storage_ == FLOAT)
+    {
+        float_vertices_.resize(nV);
+        parallel_for(int(nV), [&](int v)
+        {
+            for (int i = 0; i < 3; ++i)
+                float_vertices_[v].position[i] = float(vertices_[v].position[i]);
+            encode_octahedral(vertices_[v].normal, float_vertices_[v].normal);
+        });
+    }
+    else
+    {
+        // 65535 steps span the bounding box; guard against flat boxes
+        for (int i = 0; i < 3; ++i)
+            quantization_step_[i] = std::max(bb_max_[i] - bb_min_[i], 1e-30) / 65535.0;
+
+        quantized_vertices_.resize(nV);
+        parallel_for(int(nV), [&](int v)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                const double q = (vertices_[v].position[i] - bb_min_[i]) / quantization_step_[i];
+                quantized_vertices_[v].position[i] = uint16_t(std::max(0L, std::min(65535L, std::lround(q))));
+            }
+            encode_octahedral(vertices_[v].normal, quantized_vertices_[v].normal);
+        });
+    }
+
+    compact_triangles_.resize(triangles_.size());
+    for (size_t f = 0; f < triangles_.size(); ++f)
+    {
+        compact_triangles_[f].i0 = triangles_[f].i0;
+        compact_triangles_[f].i1 = triangles_[f].i1;
+        compact_triangles_[f].i2 = triangles_[f].i2;
+    }
+
+    std::vector<Vertex>().swap(vertices_);
+    std::vector<Triangle>().swap(triangles_);
+
+    // float rounding may move vertices slightly out of the original box
+    if (storage_ == FLOAT)
+    {
+        bb_min_ = vec3(std::numeric_limits<double>::max());
+        bb_max_ = vec3(std::numeric_limits<double>::lowest());
+        for (size_t v = 0; v < nV; ++v)
+        {
+            bb_min_ = min(bb_min_, vertex_position(int(v)));
+            bb_max_ = max(bb_max_, vertex_position(int(v)));
+        }
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+size_t Mesh::geometry_bytes() const
+{
+    return vertices_.capacity()           * sizeof(Vertex)
+         + triangles_.capacity()          * sizeof(Triangle)
+         + float_vertices_.capacity()     * sizeof(FloatVertex)
+         + quantized_vertices_.capacity() * sizeof(QuantizedVertex)
+         + compact_triangles_.capacity()  * sizeof(CompactTriangle);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Mesh::memory_usage(MemoryReport &_report, const std::string &_object) const
+{
+    _report.add(_object, "vertices", vertices_.capacity()           * sizeof(Vertex)
+                                   + float_vertices_.capacity()     * sizeof(FloatVertex)
+                                   + quantized_vertices_.capacity() * sizeof(QuantizedVertex));
+    _report.add(_object, "triangles", triangles_.capacity()         * sizeof(Triangle)
+                                    + compact_triangles_.capacity() * sizeof(CompactTriangle));
+    _report.add(_object, "bvh", bvh_.memory());
+    _report.add(_object, "adjacency", corner_first_.capacity()   * sizeof(int)
+                                    + corners_.capacity()        * sizeof(int)
+                                    + corner_weights_.capacity() * sizeof(double));
+    _report.add(_object, "mapped", resident_bytes() + bvh_.resident_bytes());
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+vec3 Mesh::vertex_normal(int _i) const
+{
+    switch (storage_)
+    {
+        case FLOAT:     return decode_octahedral(float_vertices_[_i].normal);
+        case QUANTIZED: return decode_octahedral(quantized_vertices_[_i].normal);
+        default:        return vertex_data_[_i].normal;
     }
 }
 
@@ -167,7 +1261,22 @@ void Mesh::compute_bounding_box()
 
 bool Mesh::intersect_bounding_box(const Ray& _ray) const
 {
+    double t_min = 0.0;
+    double t_max = std::numeric_limits<double>::infinity();
 
+    for (int i=0; i<3; ++i)
+    {
+        const double div = 1.0 / _ray.direction[i];
+
+        // intersect ray with min/max slab planes
+        double t1 = (bb_min_[i] - _ray.origin[i]) * div;
+        double t2 = (bb_max_[i] - _ray.origin[i]) * div;
+        if (t1 > t2) std::swap(t1, t2);
+
+        t_min = std::fmax(t_min, t1);
+        t_max = std::fmin(t_max, t2);
+        if (t_min > t_max) return false;
+    }
 
     return true;
 }
@@ -176,10 +1285,17 @@ bool Mesh::intersect_bounding_box(const Ray& _ray) const
 //-----------------------------------------------------------------------------
 
 
-bool Mesh::intersect(const Ray& _ray,
-                     vec3&      _intersection_point,
-                     vec3&      _intersection_normal,
-                     double&    _intersection_t ) const
+bool Mesh::intersect(const Ray& _ray, Hit& _hit) const
+{
+    const uint32_t root = 0;
+    return intersect(_ray, &root, 1, _hit);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool Mesh::intersect(const Ray& _ray, const uint32_t* _roots, size_t _num_roots, Hit& _hit) const
 {
     // check bounding box intersection
     if (!intersect_bounding_box(_ray))
@@ -187,29 +1303,47 @@ bool Mesh::intersect(const Ray& _ray,
         return false;
     }
 
-    vec3   p, n;
-    double t;
+    double t, beta, gamma;
 
-    _intersection_t = NO_INTERSECTION;
+    _hit.t = NO_INTERSECTION;
 
-    // for each triangle
-    for (const Triangle& triangle : triangles_)
+    // for each triangle in a leaf hit by the ray
+    const bool lazy = bvh_.lazy();
+    bvh_.traverse(_ray, _hit.t, [&](uint32_t first, uint32_t count)
     {
-        // does ray intersect triangle?
-        if (intersect_triangle(triangle, _ray, p, n, t))
+        for (uint32_t j = first; j < first + count; ++j)
         {
-            // is intersection closer than previous intersections?
-            if (t < _intersection_t)
+            const uint32_t i = lazy ? bvh_.primitive_order(j) : j;
+
+            // does ray intersect triangle?
+            if (intersect_triangle(i, _ray, t, beta, gamma))
             {
-                // store data of this intersection
-                _intersection_t      = t;
-                _intersection_point  = p;
-                _intersection_normal = n;
+                // is intersection closer than previous intersections? Ties
+                // go to the lower index, so that the hit does not depend on
+                // the traversal order (e.g. from frustum-culled roots)
+                if (t < _hit.t || (t == _hit.t && i < _hit.primitive))
+                {
+                    // store data of this intersection
+                    _hit.t         = t;
+                    _hit.primitive = i;
+                    _hit.beta      = beta;
+                    _hit.gamma     = gamma;
+                }
             }
         }
-    }
+    }, _roots, _num_roots);
 
-    return (_intersection_t != NO_INTERSECTION);
+    return (_hit.t != NO_INTERSECTION);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Mesh::surface(const Ray& _ray, const Hit& _hit, vec3& _point, vec3& _normal) const
+{
+    _point  = _ray(_hit.t);
+    _normal = triangle_normal(_hit.primitive, _hit.beta, _hit.gamma);
 }
 
 
@@ -218,18 +1352,60 @@ bool Mesh::intersect(const Ray& _ray,
 
 bool
 Mesh::
-intersect_triangle(const Triangle&  _triangle,
-                   const Ray&       _ray,
-                   vec3&            _intersection_point,
-                   vec3&            _intersection_normal,
-                   double&          _intersection_t) const
+intersect_triangle(size_t      _index,
+                   const Ray&  _ray,
+                   double&     _intersection_t,
+                   double&     _beta,
+                   double&     _gamma) const
+{
+    int i0, i1, i2;
+    triangle_vertices(_index, i0, i1, i2);
+    const vec3 p0 = vertex_position(i0);
+    const vec3 p1 = vertex_position(i1);
+    const vec3 p2 = vertex_position(i2);
+
+    // solve ray.origin + t*ray.direction = p0 + beta*(p1-p0) + gamma*(p2-p0)
+    // with Cramer's rule, using det(a,b,c) = dot(cross(a,b),c)
+    const vec3 a1 = -_ray.direction;
+    const vec3 a2 = p1 - p0;
+    const vec3 a3 = p2 - p0;
+    const vec3 b  = _ray.origin - p0;
+
+    const vec3   a2xa3 = cross(a2, a3);
+    const double denom = dot(a1, a2xa3);
+    if (std::fabs(denom) < std::numeric_limits<double>::min()) return false;
+
+    _beta = dot(cross(a1, b), a3) / denom;
+    if (_beta < 0.0 || _beta > 1.0) return false;
+
+    _gamma = dot(cross(a1, a2), b) / denom;
+    if (_gamma < 0.0 || _beta + _gamma > 1.0) return false;
+
+    _intersection_t = dot(b, a2xa3) / denom;
+    return (_intersection_t > 0.0);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+vec3 Mesh::triangle_normal(size_t _index, double _beta, double _gamma) const
 {
-    const vec3& p0 = vertices_[_triangle.i0].position;
-    const vec3& p1 = vertices_[_triangle.i1].position;
-    const vec3& p2 = vertices_[_triangle.i2].position;
+    int i0, i1, i2;
+    triangle_vertices(_index, i0, i1, i2);
 
+    if (draw_mode_ == FLAT)
+    {
+        if (storage_ == FULL) return triangle_data_[_index].normal;
+
+        const vec3 p0 = vertex_position(i0);
+        return normalize(cross(vertex_position(i1) - p0, vertex_position(i2) - p0));
+    }
 
-    return false;
+    const double alpha = 1.0 - _beta - _gamma;
+    return normalize(alpha  * vertex_normal(i0) +
+                     _beta  * vertex_normal(i1) +
+                     _gamma * vertex_normal(i2));
 }
 
 
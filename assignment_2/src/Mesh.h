@@ -15,8 +15,14 @@
 //== INCLUDES =================================================================
 
 #include "Object.h"
+#include "BVH.h"
+#include "MappedFile.h"
+#include "Frustum.h"
+#include "MemoryReport.h"
 #include <vector>
 #include <string>
+#include <memory>
+#include <cstdint>
 
 //== CLASS DEFINITION =========================================================
 
@@ -31,21 +37,66 @@ public:
     /// This type is used to choose between flat shading and Phong shading
     enum Draw_mode {FLAT, PHONG};
 
+    /// This type is used to choose how vertices and triangles are stored:
+    /// FULL keeps double positions and normals (48 bytes per vertex, 40 per
+    /// triangle). FLOAT stores float positions, QUANTIZED stores positions as
+    /// 16 bit offsets within the bounding box; both store vertex normals
+    /// octahedral-encoded in 2x16 bits and drop the triangle normals, which
+    /// are recomputed for the final hit only.
+    enum Storage {FULL, FLOAT, QUANTIZED};
+
+    /// packed meshes and their sections start at multiples of this many bytes
+    static const size_t PACKED_ALIGNMENT = 4096;
+
+    /// default number of triangles per chunk of pack()
+    static const size_t PACK_CHUNK_SIZE = 1 << 20;
+
     /// Construct a mesh by parsing its path and properties from an input
     /// stream. The mesh path read from the file is relative to the 
-    /// scene file's path "scenePath".
-    Mesh(std::istream &is, const std::string &scenePath);
+    /// scene file's path "scenePath". With \c _lazy_bvh, the BVH of an OFF
+    /// mesh is built during rendering, as rays reach its subtrees.
+    Mesh(std::istream &is, const std::string &scenePath, Storage _storage = FULL,
+         bool _lazy_bvh = false);
+
+    /// Construct a mesh from an OFF or packed (.rtm) file, e.g. for tools.
+    Mesh(const std::string &_filename, Draw_mode _mode = FLAT);
+
+    /// Construct a mesh from the packed mesh at byte \c _offset of a mapped
+    /// file, e.g. a compiled scene. Throws std::runtime_error if it is invalid.
+    Mesh(std::shared_ptr<const MappedFile> _file, size_t _offset,
+         Draw_mode _mode, const Material &_material);
 
     /// Intersect mesh with ray (calls ray-triangle intersection)
-    /// If \c _ray intersects a face of the mesh, it provides the following results:
-    /// \param[in] _ray the ray to intersect the mesh with
-    /// \param[out] _intersection_point the point of intersection
-    /// \param[out] _intersection_normal the surface normal at intersection point
-    /// \param[out] _intersection_t ray parameter at the intersection point
-    virtual bool intersect(const Ray& _ray,
-                           vec3&      _intersection_point,
-                           vec3&      _intersection_normal,
-                           double&    _intersection_t) const override;
+    /// If \c _ray intersects a face of the mesh, store the closest one's ray
+    /// parameter, triangle and barycentric coordinates in \c _hit.
+    virtual bool intersect(const Ray& _ray, Hit& _hit) const override;
+
+    /// Intersect a ray with the BVH subtrees \c _roots only, which have to
+    /// contain all triangles the ray can hit (see frustum_roots())
+    bool intersect(const Ray& _ray, const uint32_t* _roots, size_t _num_roots, Hit& _hit) const;
+
+    /// Compute the point and the normal of hit \c _hit of \c _ray, which
+    /// depends on the draw mode
+    virtual void surface(const Ray& _ray, const Hit& _hit, vec3& _point, vec3& _normal) const override;
+
+    using Object::intersect;
+
+    /// the bounding box of the mesh
+    virtual bool bounds(vec3& _min, vec3& _max) const override
+    {
+        _min = bb_min_;
+        _max = bb_max_;
+        return true;
+    }
+
+    /// Collect up to \c _max_roots BVH subtrees that contain all triangles
+    /// overlapping \c _frustum. The list is empty if the mesh is outside.
+    void frustum_roots(const Frustum& _frustum, size_t _max_roots, std::vector<uint32_t>& _roots) const
+    {
+        bvh_.collect_roots([&_frustum](const vec3& _min, const vec3& _max) {
+            return _frustum.intersects(_min, _max);
+        }, _max_roots, _roots);
+    }
 
 private:
     /// a vertex consists of a position and a normal
@@ -70,47 +121,242 @@ private:
         vec3 normal;
     };
 
+    /// a vertex with float position and octahedral normal (16 bytes)
+    struct FloatVertex
+    {
+        float    position[3];
+        uint16_t normal[2];
+    };
+
+    /// a vertex with position quantized within the bounding box (10 bytes)
+    struct QuantizedVertex
+    {
+        uint16_t position[3];
+        uint16_t normal[2];
+    };
+
+    /// a triangle without normal (12 bytes)
+    struct CompactTriangle
+    {
+        int i0, i1, i2;
+    };
+
 public:
-    /// Read mesh from an OFF file
+    /// Read mesh from an OFF file, or map it if it is a packed .rtm file.
+    /// Packed files that are truncated or corrupt throw std::runtime_error.
     bool read(const std::string &_filename);
 
+    /// Map a packed mesh written by write_packed() or pack(). Geometry and BVH
+    /// stay on disk and are paged in only when traversal touches them. All
+    /// vertex and node references are checked once; out-of-range references
+    /// throw std::runtime_error.
+    bool read_packed(const std::string &_filename);
+
+    /// Use the packed mesh starting at byte \c _offset of the mapped \c _file
+    /// in place (checked like in read_packed()). \c _name is used for messages.
+    bool attach_packed(std::shared_ptr<const MappedFile> _file, size_t _offset,
+                       const std::string &_name);
+
+    /// Write the mesh with its BVH in the packed out-of-core format. Triangles
+    /// are stored in BVH leaf order and vertices in order of first use, so
+    /// that spatially close geometry shares pages.
+    bool write_packed(const std::string &_filename) const;
+
+    /// Write the packed mesh to \c _os, section offsets are relative to the
+    /// stream position at the call, which has to be page-aligned.
+    bool write_packed(std::ostream &_os) const;
+
+    /// Convert the OFF file \c _off_file into the packed mesh \c _packed_file
+    /// without holding the mesh in memory: positions, normals and triangles
+    /// are kept in scratch files next to the output, and the triangles are
+    /// sorted into spatial chunks of about \c _chunk_size triangles whose
+    /// BVHs are built one at a time and joined under common top nodes. A
+    /// mesh of a single chunk gives the same file as write_packed().
+    static bool pack(const std::string &_off_file, const std::string &_packed_file,
+                     size_t _chunk_size = PACK_CHUNK_SIZE);
+
+    /// Size of the mapped packed mesh in bytes (0 for in-core meshes)
+    size_t mapped_bytes() const { return mapped_ ? mapped_size_ : 0; }
+
+    /// Bytes of the mapped packed mesh currently resident in memory
+    size_t resident_bytes() const { return mapped_ ? mapped_->resident_bytes(mapped_offset_, mapped_size_) : 0; }
+
+    /// File the mesh was read from, used to name it in messages and reports
+    const std::string& name() const { return name_; }
+
+    /// Add the memory of the mesh's arrays and BVH to \c _report as object
+    /// \c _object. Mapped meshes and cached BVHs count with their resident
+    /// pages.
+    virtual void memory_usage(MemoryReport &_report, const std::string &_object) const;
+
+protected:
+    /// Path of mesh file \c _meshFile given in the scene \c _scenePath
+    static std::string mesh_path(const std::string &_scenePath, const std::string &_meshFile);
+
+    /// number of vertices and triangles
+    size_t num_vertices()  const { return num_vertices_; }
+    size_t num_triangles() const { return num_triangles_; }
+
+    /// Move the vertices \c _vertices to \c _positions. Only the normals of
+    /// the triangles around them and of these triangles' vertices are
+    /// recomputed, the BVH is refit instead of rebuilt. Requires an in-core
+    /// mesh with full storage and an eagerly built BVH.
+    void move_vertices(const std::vector<int> &_vertices, const std::vector<vec3> &_positions);
+
+public:
+    /// Flat or Phong shading
+    Draw_mode draw_mode() const { return draw_mode_; }
+
+    /// Storage of vertices and triangles
+    Storage storage() const { return storage_; }
+
+    /// is the BVH built lazily during traversal (see mesh_bvh in README)?
+    bool lazy_bvh() const { return bvh_.lazy(); }
+
     /// Compute normal vectors for triangles and vertices
     void compute_normals();
 
+    /// Vertex-to-corner adjacency in compressed rows: the corners (3*f + k)
+    /// incident to vertex v are _corners[_first[v]], ..., _corners[_first[v+1]-1]
+    void vertex_corners(std::vector<int> &_first, std::vector<int> &_corners) const;
+
+    /// File caching the BVH for triangles whose bounds hash to \c _key, or
+    /// "" if caching is disabled (see README; the cache evicts least recently
+    /// used files beyond $RAYTRACE_BVH_CACHE_LIMIT MB)
+    static std::string bvh_cache_file(uint64_t _key);
+
+    /// Bounding boxes of all triangles
+    void triangle_bounds(std::vector<vec3> &_tri_min, std::vector<vec3> &_tri_max) const;
+
     /// Compute the axis-aligned bounding box, store minimum and maximum point in bb_min_ and bb_max_
     void compute_bounding_box();
 
+    /// Build the bounding volume hierarchy and reorder the triangles to match
+    /// its leaves, or prepare its lazy construction if lazy_bvh_ is set
+    void build_bvh();
+
+    /// Convert vertices_ and triangles_ to the compact storage selected by storage_
+    void compress();
+
+    /// Memory used by vertices and triangles in bytes (mapped files are not counted)
+    size_t geometry_bytes() const;
+
     /// Does \c _ray intersect the bounding box of the mesh?
     bool intersect_bounding_box(const Ray& _ray) const;
 
-    /// Intersect a triangle with a ray. Return whether there is an intersection.
-    /// If there is an intersection, store intersection data.
-    /// This function overrides Object::intersect().
-    /// \param[in] _triangle the triangle to be intersected
+    /// Intersect the triangle with index \c _index with a ray. Return whether
+    /// there is an intersection. If there is one, store its ray parameter and
+    /// barycentric coordinates; point and normal are only computed for the
+    /// closest hit by triangle_normal().
+    /// \param[in] _index index of the triangle to be intersected
     /// \param[in] _ray the ray to intersect the triangle with
-    /// \param[out] _intersection_point the point of intersection
-    /// \param[out] _intersection_normal the surface normal at intersection point
     /// \param[out] _intersection_t ray parameter at the intersection point
-    bool intersect_triangle(const Triangle&  _triangle,
-                            const Ray&       _ray,
-                            vec3&            _intersection_point,
-                            vec3&            _intersection_normal,
-                            double&          _intersection_t) const;
+    /// \param[out] _beta barycentric coordinate of the second vertex
+    /// \param[out] _gamma barycentric coordinate of the third vertex
+    bool intersect_triangle(size_t      _index,
+                            const Ray&  _ray,
+                            double&     _intersection_t,
+                            double&     _beta,
+                            double&     _gamma) const;
+
+    /// Surface normal of triangle \c _index at barycentric coordinates
+    /// (\c _beta, \c _gamma), depending on the draw mode.
+    vec3 triangle_normal(size_t _index, double _beta, double _gamma) const;
+
+protected:
+    /// vertex indices of triangle \c _index
+    void triangle_vertices(size_t _index, int& _i0, int& _i1, int& _i2) const
+    {
+        if (storage_ == FULL)
+        {
+            const Triangle& t = triangle_data_[_index];
+            _i0 = t.i0; _i1 = t.i1; _i2 = t.i2;
+        }
+        else
+        {
+            const CompactTriangle& t = compact_triangles_[_index];
+            _i0 = t.i0; _i1 = t.i1; _i2 = t.i2;
+        }
+    }
+
+    /// position of vertex \c _i
+    vec3 vertex_position(int _i) const
+    {
+        switch (storage_)
+        {
+            case FLOAT:
+            {
+                const float* p = float_vertices_[_i].position;
+                return vec3(p[0], p[1], p[2]);
+            }
+            case QUANTIZED:
+            {
+                const uint16_t* q = quantized_vertices_[_i].position;
+                return vec3(bb_min_[0] + q[0] * quantization_step_[0],
+                            bb_min_[1] + q[1] * quantization_step_[1],
+                            bb_min_[2] + q[2] * quantization_step_[2]);
+            }
+            default:
+                return vertex_data_[_i].position;
+        }
+    }
+
+    /// normal of vertex \c _i
+    vec3 vertex_normal(int _i) const;
 
 private:
     /// Does this mesh use flat or Phong shading?
     Draw_mode draw_mode_;
 
+    /// File the mesh was read from
+    std::string name_;
+
     /// Array of vertices
     std::vector<Vertex> vertices_;
 
     /// Array of triangles
     std::vector<Triangle> triangles_;
 
+    /// Vertices and triangles used for ray tracing: either the arrays above
+    /// or the sections of a mapped packed file
+    const Vertex   *vertex_data_   = nullptr;
+    const Triangle *triangle_data_ = nullptr;
+    size_t num_vertices_  = 0;
+    size_t num_triangles_ = 0;
+
+    /// Packed file backing an out-of-core mesh (may be shared by the meshes
+    /// of a compiled scene), and the range of this mesh inside it
+    std::shared_ptr<const MappedFile> mapped_;
+    size_t mapped_offset_ = 0;
+    size_t mapped_size_   = 0;
+
+    /// Storage of vertices and triangles
+    Storage storage_ = FULL;
+
+    /// Build the BVH on demand instead of at load time
+    bool lazy_bvh_ = false;
+
+    /// Compact vertices and triangles (used instead of the arrays above
+    /// if storage_ is not FULL)
+    std::vector<FloatVertex>     float_vertices_;
+    std::vector<QuantizedVertex> quantized_vertices_;
+    std::vector<CompactTriangle> compact_triangles_;
+
+    /// Size of one quantization step per axis (QUANTIZED storage)
+    vec3 quantization_step_;
+
     /// Minimum point of the bounding box
     vec3 bb_min_;
     /// Maximum point of the bounding box
     vec3 bb_max_;
+
+    /// Compact 4-wide hierarchy over triangles_
+    BVH bvh_;
+
+    /// Vertex-to-corner adjacency and angle weights of all corners, kept
+    /// for incremental normal updates by move_vertices()
+    std::vector<int>    corner_first_, corners_;
+    std::vector<double> corner_weights_;
 };
 
 
@@ -0,0 +1,170 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+
+//== INCLUDES =================================================================
+
+#include "MorphMesh.h"
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+MorphMesh::MorphMesh(std::istream &is, const std::string &scenePath)
+: Mesh(is, scenePath)
+{
+    if (num_vertices() == 0 || storage() != FULL || mapped_bytes())
+        throw std::runtime_error("Morph meshes need an OFF base mesh");
+
+    base_.resize(num_vertices());
+    for (size_t v = 0; v < base_.size(); ++v)
+        base_[v] = vertex_position(int(v));
+
+    size_t numTargets = 0;
+    is >> numTargets;
+    for (size_t t = 0; t < numTargets; ++t)
+    {
+        std::string targetFile;
+        is >> targetFile;
+        target_files_.push_back(mesh_path(scenePath, targetFile));
+        read_target(target_files_.back());
+    }
+
+    size_t numKeyframes = 0;
+    is >> numKeyframes;
+    keyframes_.assign(numKeyframes, std::vector<double>(numTargets));
+    for (auto &keyframe : keyframes_)
+        for (double &w : keyframe)
+            is >> w;
+    if (!is || keyframes_.empty())
+        throw std::runtime_error("Invalid morph mesh keyframes");
+
+    weights_.assign(numTargets, 0.0);
+    set_time(0.0);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void MorphMesh::read_target(const std::string &_filename)
+{
+    std::ifstream ifs(_filename);
+    std::string s;
+    unsigned int nV = 0, nF = 0, dummy;
+    if (!(ifs >> s) || s != "OFF" || !(ifs >> nV >> nF >> dummy))
+        throw std::runtime_error("Cannot read morph target " + _filename);
+    if (nV != num_vertices() || nF != num_triangles())
+        throw std::runtime_error("Morph target " + _filename + " differs from the base mesh");
+
+    Target target;
+    target.offsets.resize(nV);
+    for (unsigned int v = 0; v < nV; ++v)
+    {
+        vec3 p;
+        ifs >> p;
+        target.offsets[v] = p - base_[v];
+        if (norm(target.offsets[v]) > 0.0)
+            target.moved.push_back(int(v));
+    }
+
+    // the base mesh's triangles are in BVH order, compare them as sets
+    typedef std::array<int, 3> Face;
+    std::vector<Face> faces(nF), baseFaces(nF);
+    for (unsigned int f = 0; f < nF; ++f)
+    {
+        ifs >> dummy >> faces[f][0] >> faces[f][1] >> faces[f][2];
+        triangle_vertices(f, baseFaces[f][0], baseFaces[f][1], baseFaces[f][2]);
+    }
+    if (!ifs)
+        throw std::runtime_error("Cannot read morph target " + _filename);
+    std::sort(faces.begin(), faces.end());
+    std::sort(baseFaces.begin(), baseFaces.end());
+    if (faces != baseFaces)
+        throw std::runtime_error("Morph target " + _filename + " differs from the base mesh");
+
+    targets_.push_back(std::move(target));
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void MorphMesh::set_weights(const std::vector<double> &_weights)
+{
+    if (_weights.size() != targets_.size())
+        throw std::runtime_error("Wrong number of morph target weights");
+
+    // vertices of the targets whose weight changed
+    std::vector<int> vertices;
+    for (size_t t = 0; t < targets_.size(); ++t)
+        if (_weights[t] != weights_[t])
+            vertices.insert(vertices.end(), targets_[t].moved.begin(), targets_[t].moved.end());
+    weights_ = _weights;
+    if (vertices.empty()) return;
+
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+    std::vector<vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        const int v = vertices[i];
+        positions[i] = base_[v];
+        for (size_t t = 0; t < targets_.size(); ++t)
+            if (weights_[t] != 0.0)
+                positions[i] += weights_[t] * targets_[t].offsets[v];
+    }
+
+    move_vertices(vertices, positions);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void MorphMesh::set_time(double _t)
+{
+    const double s = std::min(std::max(_t, 0.0), 1.0) * (keyframes_.size() - 1);
+    const size_t k0 = size_t(std::floor(s));
+    const size_t k1 = std::min(k0 + 1, keyframes_.size() - 1);
+    const double a  = s - k0;
+
+    std::vector<double> weights(targets_.size());
+    for (size_t t = 0; t < weights.size(); ++t)
+        weights[t] = (1.0 - a) * keyframes_[k0][t] + a * keyframes_[k1][t];
+    set_weights(weights);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void MorphMesh::memory_usage(MemoryReport &_report, const std::string &_object) const
+{
+    Mesh::memory_usage(_report, _object);
+
+    size_t bytes = base_.capacity() * sizeof(vec3)
+                 + weights_.capacity() * sizeof(double);
+    for (const Target &target : targets_)
+        bytes += target.offsets.capacity() * sizeof(vec3)
+               + target.moved.capacity()   * sizeof(int);
+    for (const auto &keyframe : keyframes_)
+        bytes += keyframe.capacity() * sizeof(double);
+    _report.add(_object, "morph targets", bytes);
+}
+
+
+//=============================================================================
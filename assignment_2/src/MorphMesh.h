@@ -0,0 +1,98 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef MORPHMESH_H
+#define MORPHMESH_H
+
+
+//== INCLUDES =================================================================
+
+#include "Mesh.h"
+#include <vector>
+#include <string>
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class MorphMesh MorphMesh.h
+/// A mesh whose vertex positions blend a base shape with morph targets (blend
+/// shapes) of the same topology: position = base + sum_t w_t (target_t - base).
+/// The weights are interpolated between keyframes over the animation time.
+/// Changing them moves only the vertices of the affected targets, updates the
+/// normals around them and refits the BVH instead of rebuilding it.
+///
+/// In a scene file, a morph mesh is given as
+///
+///     morph_mesh base.off PHONG <material> T target_1.off ... target_T.off
+///                K w_11 ... w_1T ... w_K1 ... w_KT
+///
+/// i.e., like a mesh followed by T target files and K keyframes of T weights.
+class MorphMesh : public Mesh
+{
+public:
+
+    /// Construct a morph mesh by parsing its base mesh, targets and keyframes
+    /// from an input stream. Paths are relative to the scene file's path
+    /// "scenePath". Throws std::runtime_error if a target does not match the
+    /// base mesh's topology.
+    MorphMesh(std::istream &is, const std::string &scenePath);
+
+    /// number of morph targets
+    size_t num_targets() const { return targets_.size(); }
+
+    /// Set the target weights, moving only the vertices of targets whose
+    /// weight changed
+    void set_weights(const std::vector<double> &_weights);
+
+    /// Set the weights interpolated linearly between the keyframes, which are
+    /// spread evenly over the animation time \c _t in [0,1]
+    void set_time(double _t);
+
+    /// paths of the morph target files
+    const std::vector<std::string>& target_files() const { return target_files_; }
+
+    /// Add the memory of the mesh and its morph targets to \c _report
+    virtual void memory_usage(MemoryReport &_report, const std::string &_object) const override;
+
+private:
+    /// Read the positions of target \c _filename, check that it has the
+    /// topology of the base mesh and store its offsets
+    void read_target(const std::string &_filename);
+
+private:
+    /// the positions of a morph target as offsets from the base mesh
+    struct Target
+    {
+        /// offset of every vertex
+        std::vector<vec3> offsets;
+        /// vertices with nonzero offset
+        std::vector<int> moved;
+    };
+
+    /// base vertex positions
+    std::vector<vec3> base_;
+
+    /// morph targets
+    std::vector<Target> targets_;
+
+    /// paths the morph targets were read from
+    std::vector<std::string> target_files_;
+
+    /// keyframes of target weights
+    std::vector<std::vector<double>> keyframes_;
+
+    /// current target weights
+    std::vector<double> weights_;
+};
+
+
+//=============================================================================
+#endif // MORPHMESH_H defined
+//=============================================================================
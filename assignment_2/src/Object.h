@@ -19,15 +19,33 @@
 
 #include <stdexcept>
 #include <limits>
+#include <cstdint>
 
 
 //== CLASS DEFINITION =========================================================
 
 
+/// \class Hit Object.h
+/// A candidate intersection of a ray with an object: the ray parameter plus
+/// what the object needs to evaluate the surface there later, e.g. the
+/// triangle and barycentric coordinates of a mesh hit.
+struct Hit
+{
+    /// ray parameter of the intersection
+    double t = std::numeric_limits<double>::max();
+    /// primitive of the object that was hit (e.g. the triangle of a mesh)
+    uint32_t primitive = 0;
+    /// barycentric coordinates of the second and third triangle vertex
+    double beta = 0.0, gamma = 0.0;
+};
+
+
 /// \class Object Object.h
 /// This class implements an abstract class for an object.
 /// Every derived object type will inherit the material property, and it
-/// will have to override the virtual function Object::intersect().
+/// will have to override the virtual functions Object::intersect() and
+/// Object::surface(). Finding the closest hit only needs ray parameters;
+/// point and normal are evaluated once, for the final hit.
 struct Object
 {
 public:
@@ -38,16 +56,36 @@ public:
     /// has to be virtual as well).
     virtual ~Object() {}
 
-    /// Intersect the object with \c _ray, return whether there is an intersection.
-    /// If \c _ray intersects the object, provide the following results:
+    /// Intersect the object with \c _ray, return whether there is an
+    /// intersection in front of the ray origin. If there is one, store its
+    /// ray parameter and whatever surface() needs in \c _hit.
+    virtual bool intersect(const Ray& _ray, Hit& _hit) const = 0;
+
+    /// Evaluate the surface at hit \c _hit of \c _ray found by intersect().
+    /// \param[out] _point the point of intersection
+    /// \param[out] _normal the surface normal at the intersection point
+    virtual void surface(const Ray& _ray, const Hit& _hit, vec3& _point, vec3& _normal) const = 0;
+
+    /// Intersect the object with \c _ray and evaluate the surface at the hit.
     /// \param[in] _ray the ray to intersect the object with
     /// \param[out] _intersection_point the point of intersection
     /// \param[out] _intersection_normal the surface normal at intersection point
     /// \param[out] _intersection_t ray parameter at intersection point
-    virtual bool intersect(const Ray&  _ray,
-                           vec3&       _intersection_point,
-                           vec3&       _intersection_normal,
-                           double&     _intersection_t) const = 0;
+    bool intersect(const Ray&  _ray,
+                   vec3&       _intersection_point,
+                   vec3&       _intersection_normal,
+                   double&     _intersection_t) const
+    {
+        Hit hit;
+        if (!intersect(_ray, hit)) return false;
+        surface(_ray, hit, _intersection_point, _intersection_normal);
+        _intersection_t = hit.t;
+        return true;
+    }
+
+    /// Compute an axis-aligned box containing all intersection points.
+    /// Returns false for unbounded objects (the default), e.g. planes.
+    virtual bool bounds(vec3&, vec3&) const { return false; }
 
     /// parse object properties from an input stream
     virtual void parse(std::istream &is) { throw std::logic_error("Unimplemented"); }
@@ -55,6 +93,10 @@ public:
     /// The material of this object
     Material material;
 
+    /// The terms of the material used for shading, set by the scene once all
+    /// objects are loaded
+    MaterialClass material_class;
+
     static constexpr double NO_INTERSECTION = std::numeric_limits<double>::max();
 };
 
@@ -33,15 +33,13 @@ Plane::Plane(const vec3& _center, const vec3& _normal)
 
 bool
 Plane::
-intersect(const Ray& _ray,
-          vec3&      _intersection_point,
-          vec3&      _intersection_normal,
-          double&    _intersection_t ) const
+intersect(const Ray& _ray, Hit& _hit) const
 {
     /** \todo
      * - compute the intersection of the plane with `_ray`
      * - if ray and plane are parallel there is no intersection
-     * - otherwise compute intersection data and store it in `_intersection_point`, `_intersection_normal`, and `_intersection_t`.
+     * - otherwise store the ray parameter of the intersection in `_hit.t`
+     *   (point and normal are computed by surface())
      * - return whether there is an intersection in front of the viewer (t > 0)
     */
 
@@ -55,15 +53,22 @@ intersect(const Ray& _ray,
     // is perpendicular (very close to)
     if (std::abs(angle) == 0) return false;
 
-    _intersection_t = dot(normal, offset) / angle;
+    _hit.t = dot(normal, offset) / angle;
 
     // intersection behind the viewer;
-    if (_intersection_t <= 0) return false;
+    return (_hit.t > 0);
+}
+
+
+//-----------------------------------------------------------------------------
 
-    _intersection_point = origin + _intersection_t*dir;
-    _intersection_normal = normal;
 
-    return true;
+void
+Plane::
+surface(const Ray& _ray, const Hit& _hit, vec3& _point, vec3& _normal) const
+{
+    _point  = _ray.origin + _hit.t*_ray.direction;
+    _normal = normal;
 }
 
 
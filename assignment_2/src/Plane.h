@@ -34,16 +34,15 @@ public:
     Plane(std::istream &is) { parse(is); }
 
     /// Compute the intersection of the plane with \c _ray. Return whether
-    /// there is an intersection. If there is one, return the intersection data.
-    /// This function overrides Object::intersect().
-	/// \param[in] _ray the ray to intersect the plane with
-	/// \param[out] _intersection_point position of the intersection
-	/// \param[out] _intersection_normal normal vector at the intersection point
-	/// \param[out] _intersection_t ray parameter at the intesection point
-    virtual bool intersect(const Ray&  _ray,
-                           vec3&       _intersection_point,
-                           vec3&       _intersection_normal,
-                           double&     _intersection_t) const override;
+    /// there is an intersection; if there is one, store its ray parameter in
+    /// \c _hit. This function overrides Object::intersect().
+    virtual bool intersect(const Ray& _ray, Hit& _hit) const override;
+
+    /// Compute the point and normal of hit \c _hit of \c _ray.
+    /// This function overrides Object::surface().
+    virtual void surface(const Ray& _ray, const Hit& _hit, vec3& _point, vec3& _normal) const override;
+
+    using Object::intersect;
 
     /// parse plane from an input stream
     virtual void parse(std::istream &is) override {
@@ -51,6 +50,9 @@ public:
     }
 
 private:
+    /// compiled scene files store the parameters byte-wise
+    friend class Scene;
+
 	/// one (arbitrary) point on the plane
     vec3 center;
 	/// normal vector of the plane
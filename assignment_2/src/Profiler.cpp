@@ -0,0 +1,174 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== INCLUDES =================================================================
+
+#include "Profiler.h"
+#include "JsonString.h"
+
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <algorithm>
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+bool Profiler::enabled_ = false;
+const std::chrono::steady_clock::time_point Profiler::start_ = std::chrono::steady_clock::now();
+std::mutex Profiler::logs_mutex_;
+std::vector<std::unique_ptr<Profiler::ThreadLog>> Profiler::logs_;
+
+
+//-----------------------------------------------------------------------------
+
+
+Profiler::ThreadLog& Profiler::thread_log()
+{
+    thread_local ThreadLog* log = nullptr;
+    if (!log)
+    {
+        std::lock_guard<std::mutex> lock(logs_mutex_);
+        logs_.emplace_back(new ThreadLog);
+        log = logs_.back().get();
+        log->tid = int(logs_.size());
+    }
+    return *log;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Profiler::begin()
+{
+    thread_log().children.push_back(0);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Profiler::end(const char* _name, const std::string* _detail, uint64_t _begin)
+{
+    const uint64_t t = now();
+    ThreadLog& log = thread_log();
+
+    // the time of this phase is child time of the enclosing one
+    const uint64_t duration = t - _begin;
+    const uint64_t children = log.children.back();
+    log.children.pop_back();
+    if (!log.children.empty())
+        log.children.back() += duration;
+
+    log.events.push_back(Event{ _name, _detail ? *_detail : std::string(), _begin, t,
+                                duration - std::min(children, duration),
+                                int(log.children.size()) });
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool Profiler::write_trace(const std::string& _filename)
+{
+    std::ofstream ofs(_filename);
+    if (!ofs) return false;
+
+    std::lock_guard<std::mutex> lock(logs_mutex_);
+    ofs << std::fixed << std::setprecision(3);
+    ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    for (const auto& log : logs_)
+    {
+        ofs << (first ? "\n" : ",\n")
+            << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << log->tid
+            << ", \"args\": {\"name\": \"" << (log->tid == 1 ? "main" : "worker") << ' ' << log->tid << "\"}}";
+        first = false;
+
+        // complete events in microseconds
+        for (const Event& e : log->events)
+        {
+            ofs << ",\n{\"name\": " << json_string(e.name) << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << log->tid
+                << ", \"ts\": " << e.begin * 1e-3 << ", \"dur\": " << (e.end - e.begin) * 1e-3;
+            if (!e.detail.empty())
+                ofs << ", \"args\": {\"detail\": " << json_string(e.detail) << "}";
+            ofs << "}";
+        }
+    }
+    ofs << "\n]}\n";
+    return bool(ofs);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void Profiler::print_summary(std::ostream& _os, uint64_t _since)
+{
+    struct Phase
+    {
+        size_t   count = 0;
+        uint64_t total = 0, self = 0, max = 0;
+        int      depth = 0;
+        uint64_t first = 0;
+    };
+    std::map<std::string, Phase> phases;
+
+    {
+        std::lock_guard<std::mutex> lock(logs_mutex_);
+        for (const auto& log : logs_)
+            for (const Event& e : log->events)
+            {
+                if (e.begin < _since) continue;
+                Phase& p = phases[e.name];
+                const uint64_t duration = e.end - e.begin;
+                if (!p.count || e.begin < p.first)
+                {
+                    p.first = e.begin;
+                    p.depth = e.depth;
+                }
+                ++p.count;
+                p.total += duration;
+                p.self  += e.self;
+                p.max    = std::max(p.max, duration);
+            }
+    }
+    if (phases.empty()) return;
+
+    // in order of first occurrence, indented by nesting depth
+    std::vector<std::pair<std::string, Phase>> order(phases.begin(), phases.end());
+    std::sort(order.begin(), order.end(), [](const std::pair<std::string, Phase>& a,
+                                             const std::pair<std::string, Phase>& b) {
+        return a.second.first < b.second.first;
+    });
+
+    const std::ios::fmtflags flags = _os.flags();
+    const std::streamsize precision = _os.precision();
+    _os << std::fixed << std::setprecision(3);
+    _os << "  " << std::left << std::setw(28) << "phase" << std::right
+        << std::setw(8) << "count" << std::setw(13) << "total ms"
+        << std::setw(13) << "self ms" << std::setw(13) << "max ms" << "\n";
+    for (const auto& p : order)
+    {
+        const std::string name = std::string(2 * p.second.depth, ' ') + p.first;
+        _os << "  " << std::left << std::setw(28) << name << std::right
+            << std::setw(8)  << p.second.count
+            << std::setw(13) << p.second.total * 1e-6
+            << std::setw(13) << p.second.self  * 1e-6
+            << std::setw(13) << p.second.max   * 1e-6 << "\n";
+    }
+    _os.flags(flags);
+    _os.precision(precision);
+}
+
+
+//=============================================================================
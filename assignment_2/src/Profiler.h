@@ -0,0 +1,150 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+
+//== INCLUDES =================================================================
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <iostream>
+#include <cstdint>
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class Profiler Profiler.h
+/// Records nested phases (scene parsing, mesh reading, BVH builds, tiles, ...)
+/// per thread while it is enabled. Phases are timed by ProfileScope objects
+/// with the steady clock. The recorded phases can be written as a trace for
+/// chrome://tracing or Perfetto, or summarized in a table.
+///
+/// While the profiler is disabled, a scope costs a single branch. Enable or
+/// disable it only while no other thread is running scopes.
+class Profiler
+{
+public:
+
+    /// is recording enabled?
+    static bool enabled() { return enabled_; }
+
+    /// Enable or disable recording
+    static void enable(bool _enabled) { enabled_ = _enabled; }
+
+    /// steady clock time in nanoseconds since the start of the program
+    static uint64_t now()
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+    }
+
+    /// Begin a phase on the calling thread
+    static void begin();
+
+    /// End the innermost phase of the calling thread, which was begun at
+    /// \c _begin, and record it under \c _name with the optional \c _detail
+    static void end(const char* _name, const std::string* _detail, uint64_t _begin);
+
+    /// Write all phases recorded so far as Chrome trace event JSON. Returns
+    /// false if the file cannot be written.
+    static bool write_trace(const std::string& _filename);
+
+    /// Print the count, total, self and maximum time of the phases that began
+    /// at or after \c _since (see now()), grouped by name
+    static void print_summary(std::ostream& _os, uint64_t _since = 0);
+
+private:
+
+    /// a recorded phase, times in nanoseconds
+    struct Event
+    {
+        const char* name;
+        std::string detail;
+        uint64_t begin, end, self;
+        int depth;
+    };
+
+    /// phases of one thread, only written by that thread
+    struct ThreadLog
+    {
+        int tid;
+        std::vector<Event> events;
+        /// time spent in the child phases of the open phases
+        std::vector<uint64_t> children;
+    };
+
+    /// the calling thread's log, registered on first use
+    static ThreadLog& thread_log();
+
+    /// logs of all threads that recorded phases, kept until the program
+    /// ends so that pooled threads can be reused
+    static std::mutex logs_mutex_;
+    static std::vector<std::unique_ptr<ThreadLog>> logs_;
+
+    static bool enabled_;
+    static const std::chrono::steady_clock::time_point start_;
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+/// \class ProfileScope Profiler.h
+/// Times the phase \c _name from construction to destruction, if the Profiler
+/// is enabled. \c _detail, e.g. a file name, is shown in the trace and has
+/// to outlive the scope.
+class ProfileScope
+{
+public:
+
+    explicit ProfileScope(const char* _name)
+    : name_(_name), detail_(nullptr), active_(Profiler::enabled())
+    {
+        if (active_) start();
+    }
+
+    ProfileScope(const char* _name, const std::string& _detail)
+    : name_(_name), detail_(&_detail), active_(Profiler::enabled())
+    {
+        if (active_) start();
+    }
+
+    ~ProfileScope()
+    {
+        if (active_) Profiler::end(name_, detail_, begin_);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+
+    void start()
+    {
+        Profiler::begin();
+        begin_ = Profiler::now();
+    }
+
+    const char*        name_;
+    const std::string* detail_;
+    bool               active_;
+    uint64_t           begin_ = 0;
+};
+
+
+//=============================================================================
+#endif // PROFILER_H defined
+//=============================================================================
@@ -0,0 +1,175 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef RENDERPROTOCOL_H
+#define RENDERPROTOCOL_H
+
+
+//== INCLUDES =================================================================
+
+#include "vec3.h"
+
+#ifndef _WIN32
+#  include <sys/socket.h>
+#  include <unistd.h>
+#endif
+
+// macOS has no MSG_NOSIGNAL, the daemon ignores SIGPIPE there
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL)
+#  define MSG_NOSIGNAL 0
+#endif
+
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <cerrno>
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class RenderRequest RenderProtocol.h
+/// A render job sent from render_client to render_daemon. On the socket, a
+/// request is a single line of whitespace-separated tokens
+///
+///     render <scene> <output> [priority p] [size w h] [eye x y z]
+///            [center x y z] [up x y z] [fovy f] [coherent]
+///
+/// or the line `shutdown`. Paths have to be absolute and must not contain
+/// whitespace. The daemon answers with one line, either
+///
+///     ok <output> <width> <height> cached <0|1> wait_ms <t> load_ms <t> render_ms <t> rays <n>
+///
+/// or `error <message>`.
+struct RenderRequest
+{
+    /// scene file and output image
+    std::string scene, output;
+
+    /// requests with higher priority are rendered first
+    int priority = 0;
+
+    /// largest accepted image side, so that the framebuffer size cannot overflow
+    static const unsigned int MAX_SIZE = 16384;
+
+    /// camera overrides, a zero size keeps the scene's resolution
+    unsigned int width = 0, height = 0;
+    bool set_eye = false, set_center = false, set_up = false, set_fovy = false;
+    vec3 eye, center, up;
+    double fovy = 0.0;
+
+    /// trace reflected rays in sorted batches
+    bool coherent = false;
+
+    /// stop the daemon instead of rendering
+    bool shutdown = false;
+
+    /// Format the request as a protocol line (without newline)
+    std::string to_string() const
+    {
+        if (shutdown) return "shutdown";
+
+        std::ostringstream os;
+        os << std::setprecision(17) << "render " << scene << ' ' << output;
+        if (priority) os << " priority " << priority;
+        if (width && height) os << " size " << width << ' ' << height;
+        if (set_eye)    os << " eye "    << eye[0]    << ' ' << eye[1]    << ' ' << eye[2];
+        if (set_center) os << " center " << center[0] << ' ' << center[1] << ' ' << center[2];
+        if (set_up)     os << " up "     << up[0]     << ' ' << up[1]     << ' ' << up[2];
+        if (set_fovy)   os << " fovy "   << fovy;
+        if (coherent)   os << " coherent";
+        return os.str();
+    }
+
+    /// Parse a protocol line, return false and set \c _error if it is invalid
+    bool parse(const std::string& _line, std::string& _error)
+    {
+        *this = RenderRequest();
+        std::istringstream is(_line);
+        std::string token;
+        is >> token;
+        if (token == "shutdown")
+        {
+            shutdown = true;
+            return true;
+        }
+        if (token != "render" || !(is >> scene >> output))
+        {
+            _error = "expected 'render <scene> <output> ...' or 'shutdown'";
+            return false;
+        }
+
+        while (is >> token)
+        {
+            bool ok = true;
+            if      (token == "priority") ok = bool(is >> priority);
+            else if (token == "size")     ok = bool(is >> width >> height) && width && height &&
+                                             width <= MAX_SIZE && height <= MAX_SIZE;
+            else if (token == "eye")      ok = set_eye    = bool(is >> eye);
+            else if (token == "center")   ok = set_center = bool(is >> center);
+            else if (token == "up")       ok = set_up     = bool(is >> up);
+            else if (token == "fovy")     ok = set_fovy   = bool(is >> fovy);
+            else if (token == "coherent") coherent = true;
+            else ok = false;
+
+            if (!ok)
+            {
+                _error = "invalid argument '" + token + "'";
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+
+//== FUNCTIONS ================================================================
+
+
+#ifndef _WIN32
+
+/// Read one line (without newline) from socket \c _fd, return false on
+/// errors or if the connection is closed before a newline arrives.
+inline bool read_line(int _fd, std::string& _line)
+{
+    _line.clear();
+    char c;
+    for (;;)
+    {
+        const ssize_t n = ::read(_fd, &c, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        if (c == '\n') return true;
+        _line += c;
+        if (_line.size() > 64 * 1024) return false;
+    }
+}
+
+/// Write \c _line and a newline to socket \c _fd
+inline bool write_line(int _fd, const std::string& _line)
+{
+    const std::string data = _line + '\n';
+    size_t written = 0;
+    while (written < data.size())
+    {
+        const ssize_t n = ::send(_fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        written += size_t(n);
+    }
+    return true;
+}
+
+#endif
+
+
+//=============================================================================
+#endif // RENDERPROTOCOL_H defined
+//=============================================================================
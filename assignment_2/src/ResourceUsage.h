@@ -0,0 +1,91 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef RESOURCEUSAGE_H
+#define RESOURCEUSAGE_H
+
+
+//== INCLUDES =================================================================
+
+#ifndef _WIN32
+#  include <sys/resource.h>
+#  include <unistd.h>
+#endif
+
+#include <fstream>
+#include <iostream>
+#include <cstddef>
+#include <algorithm>
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class ResourceUsage ResourceUsage.h
+/// Snapshot of the memory usage and page fault counters of this process.
+/// All values are zero on platforms without getrusage().
+struct ResourceUsage
+{
+    /// current resident set size in bytes
+    size_t rss = 0;
+
+    /// peak resident set size in bytes
+    size_t peak_rss = 0;
+
+    /// page faults served without I/O
+    long minor_faults = 0;
+
+    /// page faults that required I/O
+    long major_faults = 0;
+
+    /// Take a snapshot of the current values
+    static ResourceUsage now()
+    {
+        ResourceUsage u;
+#ifndef _WIN32
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) == 0)
+        {
+#ifdef __APPLE__
+            u.peak_rss = size_t(ru.ru_maxrss);          // bytes
+#else
+            u.peak_rss = size_t(ru.ru_maxrss) * 1024;   // kilobytes
+#endif
+            u.minor_faults = ru.ru_minflt;
+            u.major_faults = ru.ru_majflt;
+        }
+
+        // current resident set is only available through /proc on Linux
+        std::ifstream statm("/proc/self/statm");
+        size_t pages_total, pages_resident;
+        if (statm >> pages_total >> pages_resident)
+            u.rss = pages_resident * size_t(sysconf(_SC_PAGESIZE));
+        u.peak_rss = std::max(u.peak_rss, u.rss);
+#endif
+        return u;
+    }
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+/// output memory usage and page faults
+inline std::ostream& operator<<(std::ostream& _os, const ResourceUsage& _u)
+{
+    _os << "rss " << _u.rss / (1024.0*1024.0) << " MB (peak " << _u.peak_rss / (1024.0*1024.0)
+        << " MB), page faults " << _u.minor_faults << " minor / " << _u.major_faults << " major";
+    return _os;
+}
+
+
+//=============================================================================
+#endif // RESOURCEUSAGE_H defined
+//=============================================================================
@@ -10,71 +10,383 @@
 
 //== INCLUDES =================================================================
 #include "Scene.h"
-
-#include "Plane.h"
-#include "Sphere.h"
-#include "Cylinder.h"
-#include "Mesh.h"
+#include "Profiler.h"
 
 #include <limits>
 #include <map>
 #include <functional>
 #include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 
 #if HAS_TBB
 #include <tbb/tbb.h>
 #include <tbb/parallel_for.h>
 #endif
 
+// edge length in pixels of the tiles used for batched secondary rays and
+// frustum culling
+static const int tile_size = 16;
+
+// maximum number of BVH subtrees per mesh and tile kept by frustum culling
+static const size_t max_tile_roots = 16;
+
+//-----------------------------------------------------------------------------
+
+// Call _f(i) for i = _begin, ..., _end-1, in parallel if _parallel is set.
+// If possible, we use TBB and try OpenMP otherwise. Note that OpenMP only
+// works on the latest clang compilers, so macOS users will probably have the
+// best luck with TBB. You can install TBB with MacPorts/Homebrew, or from Intel:
+// https://github.com/01org/tbb/releases
+// Forked worker processes pass _parallel = false, since the OpenMP runtime
+// must not be used again in a child process after fork().
+template <class Function>
+static void for_each_index(int _begin, int _end, bool _parallel, Function _f)
+{
+	if (!_parallel)
+	{
+		for (int i = _begin; i < _end; ++i)
+			_f(i);
+		return;
+	}
+
+#if HAS_TBB
+	tbb::parallel_for(tbb::blocked_range<int>(_begin, _end), [&_f](const tbb::blocked_range<int> &range) {
+		for (int i = range.begin(); i < range.end(); ++i)
+			_f(i);
+	});
+#else
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for (int i = _begin; i < _end; ++i)
+		_f(i);
+#endif
+}
+
 //-----------------------------------------------------------------------------
 
 Image Scene::render()
 {
+	ProfileScope scope("render");
 	// allocate new image.
 	Image img(camera.width, camera.height);
 
-	// Function rendering a full column of the image
-	auto raytraceColumn = [&img, this](int x) {
-		for (int y = 0; y<int(camera.height); ++y)
+	render_stats = RenderStats();
+	render_region(img, 0, 0, camera.width, camera.height);
+
+	// Note: compiler will elide copy.
+	return img;
+}
+
+//-----------------------------------------------------------------------------
+
+// The numbers 0, ..., _n-1 in bit-reversed order, e.g. 0 4 2 6 1 5 3 7, so
+// that any prefix is spread evenly over the range.
+static std::vector<int> interleaved_order(int _n)
+{
+	int bits = 0;
+	while ((1 << bits) < _n) ++bits;
+
+	std::vector<int> order;
+	for (int i = 0; i < (1 << bits); ++i)
+	{
+		int r = 0;
+		for (int b = 0; b < bits; ++b)
+			if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+		if (r < _n) order.push_back(r);
+	}
+	return order;
+}
+
+// Radical inverse of _i in base _base, used for Halton sample offsets
+static double radical_inverse(int _i, int _base)
+{
+	double result = 0.0, f = 1.0 / _base;
+	for (; _i > 0; _i /= _base, f /= _base)
+		result += f * (_i % _base);
+	return result;
+}
+
+Image Scene::render_progressive(double _budget_ms, double& _completed)
+{
+	ProfileScope scope("render progressive");
+	prepare_shadow_maps();
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point deadline = Clock::now() +
+		std::chrono::microseconds(static_cast<long long>(_budget_ms * 1000.0));
+
+	const int coarse_stride = 8;
+	const int max_samples   = 16;
+	const int width  = camera.width;
+	const int height = camera.height;
+
+	Image img(width, height);
+	std::vector<vec3> sum(width * height, vec3(0, 0, 0));
+	std::vector<int>  count(width * height, 0);
+
+	render_stats = RenderStats();
+	std::atomic<uint64_t> done(0);
+	std::atomic<bool>     expired(false);
+
+	// Trace one pass over _rows. Resolution passes (_sample == 0) trace the
+	// pixels on the grid of _stride that are not on the coarser grid and fill
+	// their _stride x _stride block, sample passes add sample _sample to all
+	// pixels. Rows are skipped once the deadline has passed (unless _finish).
+	auto pass = [&](const std::vector<int>& rows, int stride, int sample, bool finish) {
+		ProfileScope scope("progressive pass");
+		const std::vector<int> order = interleaved_order(int(rows.size()));
+		const double dx = std::fmod(radical_inverse(sample, 2) + 0.5, 1.0) - 0.5;
+		const double dy = std::fmod(radical_inverse(sample, 3) + 0.5, 1.0) - 0.5;
+
+		for_each_index(0, int(order.size()), true, [&](int i) {
+			if (!finish && (expired || Clock::now() >= deadline))
+			{
+				expired = true;
+				return;
+			}
+
+			const int y = rows[order[i]];
+			RenderStats stats;
+			uint64_t traced = 0;
+			for (int x = 0; x < width; x += (sample ? 1 : stride))
+			{
+				const int p = y * width + x;
+				if (sample == 0 && stride < coarse_stride &&
+				    x % (2 * stride) == 0 && y % (2 * stride) == 0)
+					continue;
+
+				++stats.primary_rays;
+				++traced;
+				const Ray ray = sample ? camera.subpixel_ray(x + dx, y + dy) : camera.primary_ray(x, y);
+				sum[p] += min(trace(ray, 0, stats), vec3(1, 1, 1));
+				++count[p];
+
+				if (sample)
+					img(x, y) = sum[p] / double(count[p]);
+				else
+					for (int j = y; j < std::min(y + stride, height); ++j)
+						for (int k = x; k < std::min(x + stride, width); ++k)
+							img(k, j) = sum[p];
+			}
+			done += traced;
+
+			std::lock_guard<std::mutex> lock(stats_mutex);
+			render_stats += stats;
+		});
+	};
+
+	// refine the resolution, then add samples
+	for (int stride = coarse_stride; stride >= 1 && !expired; stride /= 2)
+	{
+		std::vector<int> rows;
+		for (int y = 0; y < height; y += stride) rows.push_back(y);
+		pass(rows, stride, 0, stride == coarse_stride);
+	}
+
+	std::vector<int> rows;
+	for (int y = 0; y < height; ++y) rows.push_back(y);
+	for (int sample = 1; sample < max_samples && !expired; ++sample)
+		pass(rows, 1, sample, false);
+
+	_completed = double(done) / (double(width) * double(height) * max_samples);
+	return img;
+}
+
+//-----------------------------------------------------------------------------
+
+void Scene::render_region(Image& _img, int _x0, int _y0, int _x1, int _y1, bool _parallel)
+{
+	prepare_shadow_maps(_parallel);
+
+	Image& img = _img;
+
+	// Function rendering a full column of the region
+	auto raytraceColumn = [&img, _x0, _y0, _y1, this](int x) {
+		ProfileScope scope("render column");
+		RenderStats stats;
+		for (int y = _y0; y < _y1; ++y)
 		{
 			Ray ray = camera.primary_ray(x, y);
+			++stats.primary_rays;
 
 			// compute color by tracing this ray
-			vec3 color = trace(ray, 0);
+			vec3 color = trace(ray, 0, stats);
 
 			// avoid over-saturation
 			color = min(color, vec3(1, 1, 1));
 
 			// store pixel color
-			img(x, y) = color;
+			img(x - _x0, y - _y0) = color;
 		}
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		render_stats += stats;
 	};
 
-	// If possible, raytrace image columns in parallel. We use TBB if available
-	// and try OpenMP otherwise. Note that OpenMP only works on the latest
-	// clang compilers, so macOS users will probably have the best luck with TBB.
-	// You can install TBB with MacPorts/Homebrew, or from Intel:
-	// https://github.com/01org/tbb/releases
-#if HAS_TBB
-	tbb::parallel_for(tbb::blocked_range<int>(0, camera.width), [&raytraceColumn](const tbb::blocked_range<int> &range) {
-		for (size_t i = range.begin(); i < range.end(); ++i)
-			raytraceColumn(i);
-	});
-#else
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-	for (int x = 0; x<int(camera.width); ++x)
-		raytraceColumn(x);
-#endif
+	// Function rendering one tile of the region, either with batched
+	// secondary rays or pixel by pixel with the tile's culled objects
+	const int tiles_x = (_x1 - _x0 + tile_size - 1) / tile_size;
+	const int tiles_y = (_y1 - _y0 + tile_size - 1) / tile_size;
+	auto raytraceTile = [&img, tiles_x, _x0, _y0, _x1, _y1, this](int tile) {
+		ProfileScope scope("render tile");
+		RenderStats stats;
+		const int x0 = _x0 + (tile % tiles_x) * tile_size;
+		const int y0 = _y0 + (tile / tiles_x) * tile_size;
+		const int x1 = std::min(x0 + tile_size, _x1);
+		const int y1 = std::min(y0 + tile_size, _y1);
+		if (reorder_rays)
+			render_tile(img, _x0, _y0, x0, y0, x1, y1, stats);
+		else
+		{
+			TileCandidates candidates;
+			cull_tile(x0, y0, x1, y1, candidates, stats);
+			for (int y = y0; y < y1; ++y)
+				for (int x = x0; x < x1; ++x)
+				{
+					++stats.primary_rays;
+					vec3 color = trace(camera.primary_ray(x, y), 0, stats, &candidates);
+					img(x - _x0, y - _y0) = min(color, vec3(1, 1, 1));
+				}
+		}
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		render_stats += stats;
+	};
 
-	// Note: compiler will elide copy.
-	return img;
+	// raytrace image columns (or tiles) in parallel
+	if (reorder_rays || frustum_culling)
+		for_each_index(0, tiles_x * tiles_y, _parallel, raytraceTile);
+	else
+		for_each_index(_x0, _x1, _parallel, raytraceColumn);
+}
+
+//-----------------------------------------------------------------------------
+
+void Scene::render_tile(Image& _img, int _ox, int _oy, int _x0, int _y0, int _x1, int _y1, RenderStats& _stats)
+{
+	const int w = _x1 - _x0;
+	std::vector<vec3> colors(w * (_y1 - _y0), vec3(0, 0, 0));
+	std::vector<SecondaryRay> batch, next;
+
+	TileCandidates candidates;
+	if (frustum_culling)
+		cull_tile(_x0, _y0, _x1, _y1, candidates, _stats);
+
+	Object_ptr  object;
+	vec3        point;
+	vec3        normal;
+	double      t;
+
+	// Shade one ray of the batch: add its weighted local color to the pixel
+	// and queue the reflected ray for the next bounce.
+	auto shade = [&](const Ray& ray, double weight, unsigned int pixel, int depth) {
+		const bool hit = (depth == 0 && frustum_culling)
+		               ? intersect(ray, candidates, object, point, normal, t)
+		               : intersect(ray, object, point, normal, t);
+		if (!hit)
+		{
+			colors[pixel] += weight * background;
+			return;
+		}
+		++_stats.hits;
+
+		const double alpha = object->material.mirror;
+		colors[pixel] += (weight * (1 - alpha)) * lighting(point, normal, -ray.direction, *object);
+		if (alpha > 0 && depth < max_depth)
+		{
+			const Ray reflected = reflected_ray(ray, point, normal);
+			const double factor = continue_path(reflected, depth, weight * alpha);
+			if (factor > 0)
+				next.push_back(SecondaryRay{ reflected, weight * alpha * factor, pixel, 0 });
+		}
+	};
+
+	// primary rays in scanline order
+	if (max_depth >= 0)
+	{
+		for (int y = _y0; y < _y1; ++y)
+			for (int x = _x0; x < _x1; ++x)
+			{
+				++_stats.primary_rays;
+				shade(camera.primary_ray(x, y), 1.0, (y - _y0) * w + (x - _x0), 0);
+			}
+	}
+
+	// secondary rays bounce by bounce, sorted for coherence
+	for (int depth = 1; !next.empty(); ++depth)
+	{
+		batch.swap(next);
+		next.clear();
+		sort_rays(batch);
+		_stats.secondary_rays += batch.size();
+		for (const SecondaryRay& r : batch)
+			shade(r.ray, r.weight, r.pixel, depth);
+	}
+
+	for (int y = _y0; y < _y1; ++y)
+		for (int x = _x0; x < _x1; ++x)
+			_img(x - _ox, y - _oy) = min(colors[(y - _y0) * w + (x - _x0)], vec3(1, 1, 1));
+}
+
+//-----------------------------------------------------------------------------
+
+// Spread the lower 21 bits of \c v so that two zero bits follow each bit.
+static uint64_t spread_bits(uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffULL;
+	v = (v | v << 16) & 0x1f0000ff0000ffULL;
+	v = (v | v <<  8) & 0x100f00f00f00f00fULL;
+	v = (v | v <<  4) & 0x10c30c30c30c30c3ULL;
+	v = (v | v <<  2) & 0x1249249249249249ULL;
+	return v;
+}
+
+void Scene::sort_rays(std::vector<SecondaryRay>& _rays)
+{
+	if (_rays.size() < 2) return;
+
+	// quantize origins relative to the bounds of this batch
+	vec3 bb_min(std::numeric_limits<double>::max());
+	vec3 bb_max(std::numeric_limits<double>::lowest());
+	for (const SecondaryRay& r : _rays)
+	{
+		bb_min = min(bb_min, r.ray.origin);
+		bb_max = max(bb_max, r.ray.origin);
+	}
+	const vec3 extent = bb_max - bb_min;
+
+	for (SecondaryRay& r : _rays)
+	{
+		uint64_t code = 0;
+		unsigned int octant = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			const double rel = extent[i] > 0 ? (r.ray.origin[i] - bb_min[i]) / extent[i] : 0.0;
+			code |= spread_bits(uint64_t(rel * 1023.0)) << i;
+			if (r.ray.direction[i] < 0) octant |= 1u << i;
+		}
+		r.key = (uint64_t(octant) << 30) | code;
+	}
+
+	std::sort(_rays.begin(), _rays.end(), [](const SecondaryRay& a, const SecondaryRay& b) {
+		return a.key < b.key;
+	});
 }
 
 //-----------------------------------------------------------------------------
 
 vec3 Scene::trace(const Ray& _ray, int _depth)
+{
+	RenderStats stats;
+	return trace(_ray, _depth, stats);
+}
+
+vec3 Scene::trace(const Ray& _ray, int _depth, RenderStats& _stats,
+                  const TileCandidates* _candidates, double _throughput)
 {
 	// stop if recursion depth (=number of reflection) is too large
 	if (_depth > max_depth) return vec3(0, 0, 0);
@@ -85,13 +397,19 @@ vec3 Scene::trace(const Ray& _ray, int _depth)
 	vec3        point;
 	vec3        normal;
 	double      t;
-	if (!intersect(_ray, object, point, normal, t))
+	const bool  hit = _candidates ? intersect(_ray, *_candidates, object, point, normal, t)
+	                              : intersect(_ray, object, point, normal, t);
+	if (!hit)
 	{
 		return background;
 	}
+	++_stats.hits;
 
 	// compute local Phong lighting (ambient+diffuse+specular)
-	vec3 color = lighting(point, normal, -_ray.direction, object->material);
+	vec3 color = lighting(point, normal, -_ray.direction, *object);
+
+	// no reflection, (1 - 0) * color and the path's end are exact shortcuts
+	if (!object->material_class.mirror) return color;
 
 	/** \todo
 	 * Compute reflections by recursive ray tracing:
@@ -104,9 +422,14 @@ vec3 Scene::trace(const Ray& _ray, int _depth)
 	
 	
 	const double _alpha = object->material.mirror;
-	vec3 _ref_ray_dir = normalize(2 * normal*dot(normal, -_ray.direction) + _ray.direction);
-	Ray _ref_ray = Ray(point + _ref_ray_dir*0.0001, _ref_ray_dir);
-	color = (1 - _alpha)*color + _alpha * trace(_ref_ray, ++_depth);
+	Ray _ref_ray = reflected_ray(_ray, point, normal);
+	const double _factor = continue_path(_ref_ray, _depth, _throughput * _alpha);
+	color = (1 - _alpha)*color;
+	if (_factor > 0)
+	{
+		++_stats.secondary_rays;
+		color += _alpha * _factor * trace(_ref_ray, ++_depth, _stats, nullptr, _throughput * _alpha * _factor);
+	}
 	
 
 	return color;
@@ -114,30 +437,197 @@ vec3 Scene::trace(const Ray& _ray, int _depth)
 
 //-----------------------------------------------------------------------------
 
-bool Scene::intersect(const Ray& _ray, Object_ptr& _object, vec3& _point, vec3& _normal, double& _t)
+// A uniform random number in [0,1) that only depends on the ray, so that
+// Russian roulette gives the same image for any thread schedule.
+static double ray_random(const Ray& _ray)
 {
-	double  t, tmin(Object::NO_INTERSECTION);
-	vec3    p, n;
+	uint64_t h = 0x9e3779b97f4a7c15ULL;
+	for (int i = 0; i < 3; ++i)
+	{
+		for (double d : { _ray.origin[i], _ray.direction[i] })
+		{
+			uint64_t bits;
+			std::memcpy(&bits, &d, sizeof(bits));
+			h ^= bits;
+			// splitmix64 finalizer
+			h += 0x9e3779b97f4a7c15ULL;
+			h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+			h ^= h >> 31;
+		}
+	}
+	return double(h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double Scene::continue_path(const Ray& _reflected, int _depth, double _throughput) const
+{
+	if (_depth >= max_depth || _throughput <= 0.0)
+		return 0.0;
+	if (_throughput >= min_contribution)
+		return 1.0;
+	if (!russian_roulette)
+		return 0.0;
+
+	// survive with probability throughput / threshold, compensate the loss
+	const double p = _throughput / min_contribution;
+	return ray_random(_reflected) < p ? 1.0 / p : 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+Ray Scene::reflected_ray(const Ray& _ray, const vec3& _point, const vec3& _normal) const
+{
+	vec3 _ref_ray_dir = normalize(2 * _normal*dot(_normal, -_ray.direction) + _ray.direction);
+	return Ray(_point + _ref_ray_dir*0.0001, _ref_ray_dir);
+}
 
-	for (const auto &o : objects) // for each object
+//-----------------------------------------------------------------------------
+
+// address of an object stored by value or by pointer
+template <class T> static T* object_address(T& _object) { return &_object; }
+template <class T> static T* object_address(T* _object) { return  _object; }
+
+// Intersect _ray with all objects in _objects, which all have the same type
+// T. The qualified call T::intersect() is resolved at compile time, so the
+// loop makes no virtual calls. Only the closest hit is kept, its surface is
+// evaluated later.
+template <class Array>
+static void intersect_all(Array& _objects, const Ray& _ray, Object_ptr& _object, Hit& _closest)
+{
+	Hit hit;
+
+	for (auto &element : _objects) // for each object
 	{
-		if (o->intersect(_ray, p, n, t)) // does ray intersect object?
+		auto o = object_address(element);
+		typedef typename std::remove_pointer<decltype(o)>::type T;
+		if (o->T::intersect(_ray, hit)) // does ray intersect object?
 		{
-			if (t < tmin) // is intersection point the currently closest one?
+			if (hit.t < _closest.t) // is intersection point the currently closest one?
 			{
-				tmin = t;
-				_object = o.get();
-				_point = p;
-				_normal = n;
-				_t = t;
+				_closest = hit;
+				_object  = o;
 			}
 		}
 	}
+}
+
+bool Scene::intersect(const Ray& _ray, Object_ptr& _object, vec3& _point, vec3& _normal, double& _t)
+{
+	Hit hit;
+	if (!closest_hit(_ray, _object, hit)) return false;
+
+	_object->surface(_ray, hit, _point, _normal);
+	_t = hit.t;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Scene::closest_hit(const Ray& _ray, Object_ptr& _object, Hit& _hit)
+{
+	_hit = Hit();
+
+	intersect_all(planes,    _ray, _object, _hit);
+	intersect_all(spheres,   _ray, _object, _hit);
+	intersect_all(cylinders, _ray, _object, _hit);
+	intersect_all(meshes,    _ray, _object, _hit);
+
+	return (_hit.t != Object::NO_INTERSECTION);
+}
+
+//-----------------------------------------------------------------------------
+
+bool Scene::closest_hit(const Ray& _ray, const TileCandidates& _candidates, Object_ptr& _object, Hit& _hit)
+{
+	Hit hit;
+	_hit = Hit();
+
+	intersect_all(_candidates.planes,    _ray, _object, _hit);
+	intersect_all(_candidates.spheres,   _ray, _object, _hit);
+	intersect_all(_candidates.cylinders, _ray, _object, _hit);
+
+	// meshes only traverse the subtrees inside the tile's frustum
+	for (size_t i = 0; i < _candidates.meshes.size(); ++i)
+	{
+		const size_t begin = _candidates.root_begin[i];
+		const size_t end   = _candidates.root_begin[i + 1];
+		if (_candidates.meshes[i]->intersect(_ray, &_candidates.roots[begin], end - begin, hit) && hit.t < _hit.t)
+		{
+			_hit = hit;
+			_object = _candidates.meshes[i];
+		}
+	}
+
+	return (_hit.t != Object::NO_INTERSECTION);
+}
+
+bool Scene::intersect(const Ray& _ray, const TileCandidates& _candidates,
+                      Object_ptr& _object, vec3& _point, vec3& _normal, double& _t)
+{
+	Hit closest;
+	if (!closest_hit(_ray, _candidates, _object, closest)) return false;
+
+	_object->surface(_ray, closest, _point, _normal);
+	_t = closest.t;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void Scene::cull_tile(int _x0, int _y0, int _x1, int _y1, TileCandidates& _candidates, RenderStats& _stats)
+{
+	cull_frustum(camera.frustum(_x0, _y0, _x1, _y1), _candidates);
+
+	_stats.tile_objects    += objects.size();
+	_stats.tile_candidates += _candidates.planes.size() + _candidates.spheres.size() +
+	                          _candidates.cylinders.size() + _candidates.meshes.size();
+}
+
+void Scene::cull_frustum(const Frustum& frustum, TileCandidates& _candidates)
+{
+	// unbounded objects (planes) are always kept
+	vec3 bb_min, bb_max;
+	auto visible = [&](const Object& o) {
+		return !o.bounds(bb_min, bb_max) || frustum.intersects(bb_min, bb_max);
+	};
+
+	for (auto &o : planes)    if (visible(o)) _candidates.planes.push_back(&o);
+	for (auto &o : spheres)   if (visible(o)) _candidates.spheres.push_back(&o);
+	for (auto &o : cylinders) if (visible(o)) _candidates.cylinders.push_back(&o);
+
+	std::vector<uint32_t> roots;
+	_candidates.root_begin.push_back(0);
+	for (auto o : meshes)
+	{
+		if (!visible(*o)) continue;
+		o->frustum_roots(frustum, max_tile_roots, roots);
+		if (roots.empty()) continue;
+		_candidates.meshes.push_back(o);
+		_candidates.roots.insert(_candidates.roots.end(), roots.begin(), roots.end());
+		_candidates.root_begin.push_back(_candidates.roots.size());
+	}
+}
 
-	return (tmin != Object::NO_INTERSECTION);
+vec3 Scene::lighting(const vec3& _point, const vec3& _normal, const vec3& _view, const Object& _object)
+{
+	// the kernel without the terms the object's material does not use
+	const MaterialClass& c = _object.material_class;
+	const Material&      m = _object.material;
+	if (c.specular)
+	{
+		if (c.integral_shininess)
+			return c.diffuse ? phong<true,  true, true>(_point, _normal, _view, m, c.exponent)
+			                 : phong<false, true, true>(_point, _normal, _view, m, c.exponent);
+		return c.diffuse ? phong<true,  true, false>(_point, _normal, _view, m, 0)
+		                 : phong<false, true, false>(_point, _normal, _view, m, 0);
+	}
+	return c.diffuse ? phong<true,  false, false>(_point, _normal, _view, m, 0)
+	                 : phong<false, false, false>(_point, _normal, _view, m, 0);
 }
 
-vec3 Scene::lighting(const vec3& _point, const vec3& _normal, const vec3& _view, const Material& _material)
+template <bool Diffuse, bool Specular, bool IntegralShininess>
+vec3 Scene::phong(const vec3& _point, const vec3& _normal, const vec3& _view,
+                  const Material& _material, unsigned int _exponent)
 {	
 	//ambient contribution
 	const vec3 _amb_light = ambience * _material.ambient;
@@ -145,48 +635,211 @@ vec3 Scene::lighting(const vec3& _point, const vec3& _normal, const vec3& _view,
 	vec3 _outgoing = vec3(0, 0, 0);
 	//diffusion + specular + shadows for all light sources
 
+	// no light reaches the viewer, the shadow rays can be skipped
+	if (!Diffuse && !Specular) return _amb_light;
+
 	Object_ptr object;
-	vec3       point;
-	vec3       normal;
-	double     t;
+	Hit        hit;
 
-	for (Light &light : lights) {
+	for (size_t l = 0; l < lights.size(); ++l) {
+		const Light& light = lights[l];
 		const vec3 pos = light.position;
 		const vec3 light_dir = normalize(pos - _point);
-		const Ray ray = Ray(_point + light_dir * 0.001, light_dir);
 
-		// discard light sources blocked by objects
-		if (intersect(ray, object, point, normal, t) && t < norm(pos - _point)) continue;
+		// discard light sources blocked by objects (only the distance is needed),
+		// approximately by the light's shadow map in preview mode; area lights
+		// are weighted by their visible fraction and shaded from their center
+		double visible = 1.0;
+		if (!shadow_maps.empty())
+		{
+			if (!shadow_maps[l].lit(_point, shadow_bias)) continue;
+		}
+		else if (light.shape != Light::POINT)
+		{
+			visible = area_light_visibility(_point, light);
+			if (visible == 0.0) continue;
+		}
+		else
+		{
+			const Ray ray = Ray(_point + light_dir * 0.001, light_dir);
+			if (closest_hit(ray, object, hit) && hit.t < norm(pos - _point)) continue;
+		}
+		const vec3 color = visible * light.color;
 
 		const double angle_normal = std::max(0.0, dot(_normal, light_dir));
-		const vec3 reflection = 2 * angle_normal * _normal - light_dir;
 
-		//phong formula
-		_outgoing += light.color * (_material.diffuse * angle_normal
-				+ _material.specular * pow(std::max(0.0, dot(reflection, _view)), _material.shininess));
+		//phong formula, a zero term adds exactly nothing and is dropped
+		if (!Specular)
+		{
+			_outgoing += color * (_material.diffuse * angle_normal);
+			continue;
+		}
+
+		const vec3   reflection = 2 * angle_normal * _normal - light_dir;
+		const double rv         = std::max(0.0, dot(reflection, _view));
+		const double highlight  = IntegralShininess ? integer_power(rv, _exponent)
+		                                            : pow(rv, _material.shininess);
+		if (Diffuse)
+			_outgoing += color * (_material.diffuse * angle_normal + _material.specular * highlight);
+		else
+			_outgoing += color * (_material.specular * highlight);
 	}
 
 	return _amb_light + _outgoing;
 }
 
+double Scene::area_light_visibility(const vec3& _point, const Light& _light)
+{
+	const int n = area_light_samples;
+
+	// Within its stratum, the k-th sample is jittered by the k-th point of
+	// the R2 sequence, shifted by a hash of the shading point: the pattern
+	// changes from point to point (noise instead of banding), but every
+	// render of the scene is the same.
+	uint64_t h = 0x9e3779b97f4a7c15ull;
+	for (int i = 0; i < 3; ++i)
+	{
+		uint64_t bits;
+		const double c = _point[i];
+		std::memcpy(&bits, &c, sizeof(bits));
+		h = (h ^ bits) * 0xbf58476d1ce4e5b9ull;
+		h ^= h >> 31;
+	}
+	const double shift_s = (h >> 11) * (1.0 / 9007199254740992.0);
+	const double shift_t = ((h * 0x94d049bb133111ebull) >> 11) * (1.0 / 9007199254740992.0);
+
+	Object_ptr object;
+	Hit        hit;
+	auto blocked = [&](int _i, int _j) -> int
+	{
+		const int    k = _j * n + _i;
+		const double s = shift_s + k * 0.7548776662466927;
+		const double t = shift_t + k * 0.5698402909980532;
+		const vec3 target = _light.sample(_point, (_i + s - std::floor(s)) / n, (_j + t - std::floor(t)) / n);
+		const double distance = norm(target - _point);
+		if (distance < 1e-10) return 0;
+		const vec3 dir = (target - _point) / distance;
+		const Ray ray = Ray(_point + dir * 0.001, dir);
+		return closest_hit(ray, object, hit) && hit.t < distance;
+	};
+
+	if (n == 1) return 1.0 - blocked(0, 0);
+
+	// one sample per quadrant; if they agree, the point is taken to be fully
+	// lit or fully shadowed
+	const int lo = n / 4, hi = n - 1 - lo;
+	int count = blocked(lo, lo) + blocked(hi, lo) + blocked(lo, hi) + blocked(hi, hi);
+	if (count == 0) return 1.0;
+	if (count == 4) return 0.0;
+
+	// penumbra: the remaining strata
+	for (int j = 0; j < n; ++j)
+		for (int i = 0; i < n; ++i)
+			if (!((i == lo || i == hi) && (j == lo || j == hi)))
+				count += blocked(i, j);
+	return 1.0 - double(count) / (n * n);
+}
+
+//-----------------------------------------------------------------------------
+
+void Scene::build_shadow_maps(bool _parallel)
+{
+	ProfileScope scope("build shadow maps");
+	const int n = shadow_map_resolution;
+	const int tiles = (n + tile_size - 1) / tile_size;
+	shadow_maps.resize(lights.size());
+	for (size_t l = 0; l < lights.size(); ++l)
+	{
+		CubeShadowMap &map = shadow_maps[l];
+		map.reset(lights[l].position, n);
+
+		// Like the image, each face is covered by tiles: the objects inside
+		// a tile's frustum are collected once, then each texel stores the
+		// distance of the closest surface along its center ray.
+		for_each_index(0, 6 * tiles * tiles, _parallel, [this, &map, n, tiles](int tile) {
+			const int face = tile / (tiles * tiles);
+			const int i0 = (tile % tiles) * tile_size;
+			const int j0 = (tile / tiles % tiles) * tile_size;
+			const int i1 = std::min(i0 + tile_size, n);
+			const int j1 = std::min(j0 + tile_size, n);
+
+			TileCandidates candidates;
+			cull_frustum(map.texel_frustum(face, i0, j0, i1, j1), candidates);
+
+			Object_ptr object;
+			Hit        hit;
+			for (int j = j0; j < j1; ++j)
+				for (int i = i0; i < i1; ++i)
+					if (closest_hit(map.texel_ray(face, i, j), candidates, object, hit))
+						map.set(face, i, j, hit.t);
+		});
+	}
+}
+
 //-----------------------------------------------------------------------------
 
 void Scene::read(const std::string &_filename)
 {
+	sources.push_back(_filename);
+
+	// compiled scenes are mapped instead of parsed
+	if (_filename.size() > 4 && _filename.compare(_filename.size() - 4, 4, ".rts") == 0)
+	{
+		read_compiled(_filename);
+		collect_objects();
+		return;
+	}
+
+	ProfileScope scope("parse scene", _filename);
 	std::ifstream ifs(_filename);
 	if (!ifs)
 		throw std::runtime_error("Cannot open file " + _filename);
 
+	// storage of subsequent meshes, changed by "mesh_storage full|float|quantized"
+	Mesh::Storage meshStorage = Mesh::FULL;
+	auto parseMeshStorage = [&]() {
+		std::string mode;
+		ifs >> mode;
+		if      (mode == "full")      meshStorage = Mesh::FULL;
+		else if (mode == "float")     meshStorage = Mesh::FLOAT;
+		else if (mode == "quantized") meshStorage = Mesh::QUANTIZED;
+		else throw std::runtime_error("Invalid mesh storage " + mode);
+	};
+
+	// BVH construction of subsequent meshes, changed by "mesh_bvh eager|lazy"
+	bool lazyBVH = false;
+	auto parseMeshBVH = [&]() {
+		std::string mode;
+		ifs >> mode;
+		if      (mode == "eager") lazyBVH = false;
+		else if (mode == "lazy")  lazyBVH = true;
+		else throw std::runtime_error("Invalid mesh BVH mode " + mode);
+	};
+
 	const std::map<std::string, std::function<void(void)>> entityParser = {
 		{"depth",      [&]() { ifs >> max_depth; }},
 		{"camera",     [&]() { ifs >> camera; }},
 		{"background", [&]() { ifs >> background; }},
 		{"ambience",   [&]() { ifs >> ambience; }},
 		{"light",      [&]() { lights.emplace_back(ifs); }},
-		{"plane",      [&]() { objects.emplace_back(new    Plane(ifs)); }},
-		{"sphere",     [&]() { objects.emplace_back(new   Sphere(ifs)); }},
-		{"cylinder",   [&]() { objects.emplace_back(new Cylinder(ifs)); }},
-		{"mesh",       [&]() { objects.emplace_back(new     Mesh(ifs, _filename)); }}
+		{"rect_light",   [&]() { lights.emplace_back(ifs, Light::RECTANGLE); }},
+		{"sphere_light", [&]() { lights.emplace_back(ifs, Light::SPHERE); }},
+		{"plane",      [&]() { planes.emplace_back(ifs); }},
+		{"sphere",     [&]() { spheres.emplace_back(ifs); }},
+		{"cylinder",   [&]() { cylinders.emplace_back(ifs); }},
+		{"mesh",       [&]() {
+			meshes.push_back(arena.create<Mesh>(ifs, _filename, meshStorage, lazyBVH));
+			sources.push_back(meshes.back()->name());
+		}},
+		{"morph_mesh", [&]() {
+			MorphMesh *mesh = arena.create<MorphMesh>(ifs, _filename);
+			morph_meshes.push_back(mesh);
+			meshes.push_back(mesh);
+			sources.push_back(mesh->name());
+			sources.insert(sources.end(), mesh->target_files().begin(), mesh->target_files().end());
+		}},
+		{"mesh_storage", parseMeshStorage},
+		{"mesh_bvh",     parseMeshBVH}
 	};
 
 	// parse file
@@ -201,6 +854,43 @@ void Scene::read(const std::string &_filename)
 			throw std::runtime_error("Invalid token encountered: " + token);
 		entityParser.at(token)();
 	}
+
+	collect_objects();
+}
+
+//-----------------------------------------------------------------------------
+
+void Scene::collect_objects()
+{
+	// the arrays are complete, so the addresses of their elements are final
+	objects.clear();
+	for (auto &o : planes)    objects.push_back(&o);
+	for (auto &o : spheres)   objects.push_back(&o);
+	for (auto &o : cylinders) objects.push_back(&o);
+	for (auto  o : meshes)    objects.push_back(o);
+
+	for (auto  o : objects)   o->material_class = classify(o->material);
+}
+
+
+//-----------------------------------------------------------------------------
+
+void Scene::memory_usage(MemoryReport &_report) const
+{
+	_report.add("scene", "lights", lights.capacity() * sizeof(Light));
+	size_t shadow_map_bytes = 0;
+	for (const CubeShadowMap &map : shadow_maps)
+		shadow_map_bytes += map.memory();
+	_report.add("scene", "shadow maps", shadow_map_bytes);
+	_report.add("scene", "objects", planes.capacity()    * sizeof(Plane)
+	                              + spheres.capacity()   * sizeof(Sphere)
+	                              + cylinders.capacity() * sizeof(Cylinder)
+	                              + arena.capacity()
+	                              + objects.capacity()   * sizeof(Object_ptr)
+	                              + meshes.capacity()    * sizeof(Mesh*));
+	// keyed by index, since a mesh file may be loaded more than once
+	for (size_t i = 0; i < meshes.size(); ++i)
+		meshes[i]->memory_usage(_report, "mesh " + std::to_string(i) + " " + meshes[i]->name());
 }
 
 
@@ -20,13 +20,62 @@
 #include "Material.h"
 #include "Image.h"
 #include "Camera.h"
+#include "Plane.h"
+#include "Sphere.h"
+#include "Cylinder.h"
+#include "Mesh.h"
+#include "MorphMesh.h"
+#include "Arena.h"
+#include "ShadowMap.h"
 
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
 
 //== CLASS DEFINITION =========================================================
 
-/// \class Sphere Sphere.h
+/// \class RenderStats Scene.h
+/// Ray counters gathered during Scene::render(). Each column/tile counts
+/// into a local instance that is merged once at its end.
+struct RenderStats
+{
+    /// number of camera rays
+    uint64_t primary_rays = 0;
+
+    /// number of reflected rays
+    uint64_t secondary_rays = 0;
+
+    /// number of rays (primary and secondary) that hit an object
+    uint64_t hits = 0;
+
+    /// objects in the scene and objects kept by frustum culling, summed
+    /// over all image tiles
+    uint64_t tile_objects = 0;
+    uint64_t tile_candidates = 0;
+
+    /// total number of traced rays
+    uint64_t rays() const { return primary_rays + secondary_rays; }
+
+    /// fraction of traced rays that hit an object
+    double hit_rate() const { return rays() ? double(hits) / double(rays()) : 0.0; }
+
+    /// accumulate the counters of \c _other
+    RenderStats& operator+=(const RenderStats& _other)
+    {
+        primary_rays   += _other.primary_rays;
+        secondary_rays += _other.secondary_rays;
+        hits           += _other.hits;
+        tile_objects    += _other.tile_objects;
+        tile_candidates += _other.tile_candidates;
+        return *this;
+    }
+};
+
+
+/// \class Scene Scene.h
 /// This class loads and raytraces scenes consisting of cameras, lights, and
 /// objects
 class Scene {
@@ -39,6 +88,91 @@ public:
     /// Allocate image and raytrace the scene.
     Image  render();
 
+    /// Render progressively until \c _budget_ms milliseconds have passed: a
+    /// coarse pass that traces every 8th pixel per axis, which is always
+    /// completed, is refined to full resolution and then to up to 16 samples
+    /// per pixel. Within each pass rows are traced in interleaved order, so
+    /// the image is refined evenly when time runs out.
+    /// \param[out] _completed fraction of the refinement work that was done
+    /// \return the best image so far
+    Image  render_progressive(double _budget_ms, double& _completed);
+
+    /// Raytrace the pixels [_x0,_x1)x[_y0,_y1) of the camera image into
+    /// \c _img, which has the size of this region: pixel (x,y) is stored in
+    /// _img(x-_x0, y-_y0). Ray counters are added to stats().
+    /// \param _parallel use TBB/OpenMP threads (forked workers pass false)
+    void   render_region(Image& _img, int _x0, int _y0, int _x1, int _y1, bool _parallel = true);
+
+    /// Enable batched tracing of secondary rays: reflected rays are collected
+    /// per image tile, sorted by origin cell and direction octant, and traced
+    /// one bounce at a time instead of recursing in pixel order.
+    void set_ray_reordering(bool _enabled) { reorder_rays = _enabled; }
+
+    /// Enable per-tile frustum culling (on by default): before tracing an
+    /// image tile, objects and mesh BVH subtrees outside the frustum of its
+    /// primary rays are removed, and primary rays only test the rest.
+    void set_frustum_culling(bool _enabled) { frustum_culling = _enabled; }
+
+    /// Terminate reflection paths whose contribution to the pixel (the
+    /// product of the mirror factors along the path) falls below
+    /// \c _threshold. Paths without any contribution always terminate.
+    void set_min_contribution(double _threshold) { min_contribution = _threshold; }
+
+    /// Instead of cutting paths below the contribution threshold, continue
+    /// them with probability contribution/threshold and scale up the
+    /// survivors, which keeps the expected color unbiased.
+    void set_russian_roulette(bool _enabled) { russian_roulette = _enabled; }
+
+    /// Preview quality: instead of tracing a shadow ray per light and
+    /// shading point, look up a cube shadow map of \c _resolution^2 texels
+    /// per face, which is built for each light before rendering. \c _bias is
+    /// the relative depth tolerance against self-shadowing, by default four
+    /// texels' angle. A resolution of 0 (the default) traces exact shadow rays.
+    void set_shadow_maps(int _resolution, double _bias = -1.0)
+    {
+        shadow_map_resolution = _resolution;
+        shadow_bias = (_bias < 0.0 && _resolution > 0) ? 4.0 / _resolution : _bias;
+        shadow_maps.clear();
+    }
+
+    /// Soft shadows of area lights: their visibility is estimated from
+    /// \c _n x \c _n stratified shadow rays (4 x 4 by default). One ray per
+    /// quadrant is traced first, and the remaining strata only if these
+    /// disagree, so that fully lit and fully shadowed points cost four rays.
+    void set_area_light_samples(int _n) { area_light_samples = std::max(1, _n); }
+
+    /// Set the animation time \c _t in [0,1] of all morph meshes, which
+    /// deforms them according to their keyframes
+    void set_time(double _t)
+    {
+        for (MorphMesh* m : morph_meshes) m->set_time(_t);
+        if (animated()) shadow_maps.clear();
+    }
+
+    /// Build the shadow maps (see set_shadow_maps()) if they are enabled and
+    /// missing. Rendering does this itself; call it before forking render
+    /// workers, so that they share the maps instead of each building them.
+    /// \param _parallel use TBB/OpenMP threads
+    void prepare_shadow_maps(bool _parallel = true)
+    {
+        if (shadow_map_resolution > 0 && shadow_maps.size() != lights.size())
+            build_shadow_maps(_parallel);
+    }
+
+    /// does the scene contain animated meshes?
+    bool animated() const { return !morph_meshes.empty(); }
+
+    /// Ray counters of the last call to render(), or of all calls to
+    /// render_region() since then.
+    const RenderStats &stats() const { return render_stats; }
+
+    /// Add ray counters gathered elsewhere, e.g. by forked render workers
+    void add_stats(const RenderStats &_stats)
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        render_stats += _stats;
+    }
+
     /// Determine the color seen by a viewing ray
     /**
     *	@param[in] _ray passed Ray
@@ -63,27 +197,152 @@ public:
     *	@param _point the point, whose color should be determined.
     *	@param _normal `_point`'s normal
     *	@param _view normalized direction from the point to the viewer's position.
-    * 	@param _material holds material parameters of the `_point`, that should be lit.
+    * 	@param _object the intersected object, whose material (and material
+    * 	class, which selects the shading kernel) is used.
     */
-    vec3  lighting(const vec3& _point, const vec3& _normal, const vec3& _view, const Material& _material);
+    vec3  lighting(const vec3& _point, const vec3& _normal, const vec3& _view, const Object& _object);
 
+    /// Read a scene file, or map a compiled scene if the name ends in .rts
     void read(const std::string &filename);
 
+    /// Write the parsed scene into a compiled scene file: camera, lights and
+    /// primitives as binary records, meshes with their BVHs in the packed
+    /// format. Loading it only maps the file, nothing is parsed or built.
+    /// Requires full mesh storage, eagerly built BVHs and no morph meshes;
+    /// nothing is left behind on failure.
+    bool write_compiled(const std::string &_filename) const;
+
     size_t numObjects() const { return objects.size(); }
 
+    /// Add the memory of lights, objects and meshes to \c _report
+    void memory_usage(MemoryReport &_report) const;
+
     // Accessors for scene objects and camera for debugging.
-    const std::vector<std::unique_ptr<Object>> &getObjects() const { return objects; }
+    const std::vector<Object_ptr> &getObjects() const { return objects; }
     const Camera &getCamera() const { return camera; }
 
+    /// Replace the camera, e.g. to render another view of a loaded scene
+    void setCamera(const Camera &_camera) { camera = _camera; }
+
+    /// The files the scene was read from: the scene file, then the mesh and
+    /// morph target files it references (e.g. to notice changes)
+    const std::vector<std::string> &source_files() const { return sources; }
+
 private:
+    /// a reflected ray waiting in a tile's batch
+    struct SecondaryRay
+    {
+        /// the reflected ray
+        Ray ray;
+        /// product of the mirror weights along the path so far
+        double weight;
+        /// index of the pixel inside the tile
+        unsigned int pixel;
+        /// sort key: direction octant above a Morton code of the origin
+        uint64_t key;
+    };
+
+    /// objects that the primary rays of an image tile can hit
+    struct TileCandidates
+    {
+        std::vector<Plane*>    planes;
+        std::vector<Sphere*>   spheres;
+        std::vector<Cylinder*> cylinders;
+        std::vector<Mesh*>     meshes;
+        /// BVH subtree roots of meshes[i] are roots[root_begin[i]], ..., roots[root_begin[i+1]-1]
+        std::vector<uint32_t>  roots;
+        std::vector<size_t>    root_begin;
+    };
+
+    /// recursive tracing that counts rays into \c _stats. Primary rays may
+    /// pass the \c _candidates of their tile. \c _throughput is the weight
+    /// of this ray's color in the pixel.
+    vec3  trace(const Ray& _ray, int _depth, RenderStats& _stats,
+                const TileCandidates* _candidates = nullptr, double _throughput = 1.0);
+
+    /// Decide whether to trace the reflected ray \c _reflected, leaving a
+    /// surface hit at recursion depth \c _depth, whose color would enter the
+    /// pixel with weight \c _throughput. Returns 0 to terminate the path,
+    /// otherwise the factor to scale the reflected color with (1, or the
+    /// inverse survival probability of Russian roulette).
+    double continue_path(const Ray& _reflected, int _depth, double _throughput) const;
+
+    /// closest hit of \c _ray and the object it belongs to, without
+    /// evaluating the surface there (e.g. for shadow rays)
+    bool  closest_hit(const Ray& _ray, Object_ptr& _object, Hit& _hit);
+
+    /// closest hit of \c _ray with the candidates of a tile
+    bool  closest_hit(const Ray& _ray, const TileCandidates& _candidates, Object_ptr& _object, Hit& _hit);
+
+    /// closest intersection with the candidates of a tile, see intersect()
+    bool  intersect(const Ray& _ray, const TileCandidates& _candidates,
+                    Object_ptr&, vec3& _point, vec3& _normal, double& _t);
+
+    /// collect the candidates of the tile [_x0,_x1)x[_y0,_y1)
+    void  cull_tile(int _x0, int _y0, int _x1, int _y1, TileCandidates& _candidates, RenderStats& _stats);
+
+    /// collect the objects and mesh subtrees overlapping \c _frustum
+    void  cull_frustum(const Frustum& _frustum, TileCandidates& _candidates);
+
+    /// reflect \c _ray at the surface point \c _point with normal \c _normal
+    Ray   reflected_ray(const Ray& _ray, const vec3& _point, const vec3& _normal) const;
+
+    /// render the tile [_x0,_x1)x[_y0,_y1) with batched secondary rays into
+    /// \c _img, whose pixel (0,0) corresponds to pixel (_ox,_oy)
+    void  render_tile(Image& _img, int _ox, int _oy, int _x0, int _y0, int _x1, int _y1, RenderStats& _stats);
+
+    /// map a file written by write_compiled(), throw std::runtime_error on failure
+    void read_compiled(const std::string &_filename);
+
+    /// cast one ray per texel to build the shadow maps of all lights
+    /// \param _parallel use TBB/OpenMP threads (forked workers pass false)
+    void build_shadow_maps(bool _parallel);
+
+    /// fill \c objects from the per-type arrays once they are complete and
+    /// classify their materials
+    void collect_objects();
+
+    /// fraction of the area light \c _light that is visible from \c _point,
+    /// see set_area_light_samples()
+    double area_light_visibility(const vec3& _point, const Light& _light);
+
+    /// Phong lighting kernel without the diffuse or specular term if
+    /// \c Diffuse or \c Specular is false, with integer_power() instead of
+    /// pow() if \c IntegralShininess is true. Lights are only tested for
+    /// shadows if a term remains.
+    template <bool Diffuse, bool Specular, bool IntegralShininess>
+    vec3  phong(const vec3& _point, const vec3& _normal, const vec3& _view,
+                const Material& _material, unsigned int _exponent);
+
+    /// sort a batch of secondary rays for coherent traversal
+    static void sort_rays(std::vector<SecondaryRay>& _rays);
+
     /// camera stores eye position, view direction, and can generate primary rays
     Camera camera;
 
     /// array for all lights in the scene
     std::vector<Light> lights;
 
-    /// array for all the objects in the scene
-    std::vector<std::unique_ptr<Object>> objects;
+    /// scene, mesh and morph target files, see source_files()
+    std::vector<std::string> sources;
+
+    /// Objects are stored contiguously per type, so that intersect() can
+    /// loop over each array with non-virtual calls
+    std::vector<Plane>    planes;
+    std::vector<Sphere>   spheres;
+    std::vector<Cylinder> cylinders;
+
+    /// meshes are large and own further arrays, they are placed in the arena
+    std::vector<Mesh*>    meshes;
+
+    /// the meshes above that are morph meshes
+    std::vector<MorphMesh*> morph_meshes;
+
+    /// holds the objects that are not stored in the arrays above
+    Arena arena;
+
+    /// non-owning array of all the objects in the scene
+    std::vector<Object_ptr> objects;
 
     /// max recursion depth for mirroring
     int max_depth = 0;
@@ -93,6 +352,36 @@ private:
 
     /// global ambient light
     vec3 ambience = vec3(0, 0, 0);
+
+    /// trace secondary rays in sorted per-tile batches
+    bool reorder_rays = false;
+
+    /// cull objects against the frustum of each tile
+    bool frustum_culling = true;
+
+    /// contribution below which reflection paths terminate
+    double min_contribution = 0.0;
+
+    /// continue paths below min_contribution randomly
+    bool russian_roulette = false;
+
+    /// texels per face side of the shadow maps (0: exact shadow rays)
+    int shadow_map_resolution = 0;
+
+    /// relative depth tolerance of shadow map lookups
+    double shadow_bias = 0.01;
+
+    /// strata per side of the shadow rays to area lights
+    int area_light_samples = 4;
+
+    /// shadow map of each light, built before the next render if empty
+    std::vector<CubeShadowMap> shadow_maps;
+
+    /// counters of the last render
+    RenderStats render_stats;
+
+    /// guards merging of per-tile counters into render_stats
+    std::mutex stats_mutex;
 };
 
 //=============================================================================
@@ -0,0 +1,89 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== INCLUDES =================================================================
+
+#include "ShadowMap.h"
+
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+void CubeShadowMap::reset(const vec3& _position, int _resolution)
+{
+    position_   = _position;
+    resolution_ = _resolution;
+    depth_.assign(6 * size_t(_resolution) * _resolution, std::numeric_limits<float>::infinity());
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+vec3 CubeShadowMap::direction(int _face, double _s, double _t) const
+{
+    // the face's axis points outwards, the texel coordinates run along the
+    // two following axes
+    const int axis = _face / 2;
+    vec3 d;
+    d[axis]           = (_face % 2) ? -1.0 : 1.0;
+    d[(axis + 1) % 3] = -1.0 + 2.0 * _s / resolution_;
+    d[(axis + 2) % 3] = -1.0 + 2.0 * _t / resolution_;
+    return d;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+Ray CubeShadowMap::texel_ray(int _face, int _i, int _j) const
+{
+    return Ray(position_, normalize(direction(_face, _i + 0.5, _j + 0.5)));
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+Frustum CubeShadowMap::texel_frustum(int _face, int _i0, int _j0, int _i1, int _j1) const
+{
+    const vec3 d[4] = { direction(_face, _i0, _j0), direction(_face, _i1, _j0),
+                        direction(_face, _i1, _j1), direction(_face, _i0, _j1) };
+    return Frustum(position_, d);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool CubeShadowMap::lit(const vec3& _point, double _bias) const
+{
+    const vec3 d = _point - position_;
+    const double a[3] = { std::fabs(d[0]), std::fabs(d[1]), std::fabs(d[2]) };
+    const int axis = (a[0] >= a[1] && a[0] >= a[2]) ? 0 : (a[1] >= a[2] ? 1 : 2);
+    if (a[axis] == 0.0) return true;
+
+    // project onto the face of the major axis
+    const int face = 2 * axis + (d[axis] < 0.0);
+    const double u = d[(axis + 1) % 3] / a[axis];
+    const double v = d[(axis + 2) % 3] / a[axis];
+    const int i = std::min(std::max(int((u + 1.0) * 0.5 * resolution_), 0), resolution_ - 1);
+    const int j = std::min(std::max(int((v + 1.0) * 0.5 * resolution_), 0), resolution_ - 1);
+
+    const float depth = depth_[(size_t(face) * resolution_ + j) * resolution_ + i];
+    return norm(d) <= double(depth) * (1.0 + _bias);
+}
+
+
+//=============================================================================
@@ -0,0 +1,88 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef SHADOWMAP_H
+#define SHADOWMAP_H
+
+
+//== INCLUDES =================================================================
+
+#include "vec3.h"
+#include "Ray.h"
+#include "Frustum.h"
+#include <vector>
+#include <cstddef>
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class CubeShadowMap ShadowMap.h
+/// Approximate shadows of a point light: for each texel of the six faces of a
+/// cube around the light, the distance from the light to the closest surface
+/// in the texel's direction. A point is lit if it is not farther from the
+/// light than the surface stored in its texel (up to a relative bias), so a
+/// lookup replaces a shadow ray. The faces are ordered +x, -x, +y, -y, +z, -z
+/// like the cube maps of OpenGL.
+class CubeShadowMap
+{
+public:
+
+    /// Allocate the faces for a light at \c _position with
+    /// \c _resolution x \c _resolution texels each, all of them unoccluded
+    void reset(const vec3& _position, int _resolution);
+
+    /// number of texels per face side
+    int resolution() const { return resolution_; }
+
+    /// The ray from the light through the center of texel (\c _i, \c _j) of
+    /// face \c _face, its parameter is the distance to the light
+    Ray texel_ray(int _face, int _i, int _j) const;
+
+    /// The frustum from the light through the texels [_i0,_i1)x[_j0,_j1)
+    /// of face \c _face
+    Frustum texel_frustum(int _face, int _i0, int _j0, int _i1, int _j1) const;
+
+    /// Store the distance \c _distance of the closest surface in texel
+    /// (\c _i, \c _j) of face \c _face
+    void set(int _face, int _i, int _j, double _distance)
+    {
+        depth_[(size_t(_face) * resolution_ + _j) * resolution_ + _i] = float(_distance);
+    }
+
+    /// Is \c _point visible from the light? \c _bias is the relative
+    /// tolerance that keeps surfaces from shadowing themselves.
+    bool lit(const vec3& _point, double _bias) const;
+
+    /// memory used by the faces in bytes
+    size_t memory() const { return depth_.capacity() * sizeof(float); }
+
+private:
+
+    /// direction from the light through texel coordinates (\c _s, \c _t) of
+    /// face \c _face, where texel (i,j) covers [i,i+1]x[j,j+1]
+    vec3 direction(int _face, double _s, double _t) const;
+
+private:
+
+    /// position of the light
+    vec3 position_;
+
+    /// texels per face side
+    int resolution_ = 0;
+
+    /// distances of the six faces, row by row
+    std::vector<float> depth_;
+};
+
+
+//=============================================================================
+#endif // SHADOWMAP_H defined
+//=============================================================================
@@ -0,0 +1,311 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== INCLUDES =================================================================
+
+#include "Shard.h"
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <new>
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+// magic bytes at the start of a partial image (colors are stored as
+// doubles, so merged frames equal a render in one process)
+static const char SHARD_MAGIC[8] = { 'R', 'T', 'S', 'H', 'A', 'R', 'D', '2' };
+
+
+//-----------------------------------------------------------------------------
+
+
+std::vector<Region> split_into_tiles(const Region& _region, int _tile_size)
+{
+    std::vector<Region> tiles;
+    for (int y = _region.y0; y < _region.y1; y += _tile_size)
+        for (int x = _region.x0; x < _region.x1; x += _tile_size)
+        {
+            Region t;
+            t.x0 = x;
+            t.y0 = y;
+            t.x1 = std::min(x + _tile_size, _region.x1);
+            t.y1 = std::min(y + _tile_size, _region.y1);
+            tiles.push_back(t);
+        }
+    return tiles;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+std::vector<Region> shard_tiles(const std::vector<Region>& _tiles, int _index, int _count)
+{
+    std::vector<Region> tiles;
+    for (size_t t = _index; t < _tiles.size(); t += _count)
+        tiles.push_back(_tiles[t]);
+    return tiles;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+// copy the pixels of _tile from _src (covering _src_region) to _dst (covering _dst_region)
+static void copy_tile(const Region& _tile,
+                      const Image& _src, const Region& _src_region,
+                      Image& _dst, const Region& _dst_region)
+{
+    for (int y = _tile.y0; y < _tile.y1; ++y)
+        for (int x = _tile.x0; x < _tile.x1; ++x)
+            _dst(x - _dst_region.x0, y - _dst_region.y0) = _src(x - _src_region.x0, y - _src_region.y0);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+#ifndef _WIN32
+
+// header of the framebuffer shared by the forked workers
+struct SharedFrame
+{
+    /// index of the next tile to render
+    std::atomic<uint32_t> next_tile;
+
+    /// summed ray counters of all workers
+    std::atomic<uint64_t> primary_rays, secondary_rays, hits;
+};
+
+
+// render _tiles with _workers forked processes
+static void render_forked(Scene& _scene, const Region& _region, const std::vector<Region>& _tiles,
+                          int _workers, Image& _img)
+{
+    const size_t num_pixels = size_t(_region.width()) * size_t(_region.height());
+    const size_t bytes      = sizeof(SharedFrame) + 3 * num_pixels * sizeof(double);
+
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        throw std::runtime_error("Cannot allocate shared framebuffer");
+
+    SharedFrame* frame = new (memory) SharedFrame();
+    frame->next_tile = 0;
+    frame->primary_rays = frame->secondary_rays = frame->hits = 0;
+    // full precision colors, so that the image equals a serial render
+    double* pixels = reinterpret_cast<double*>(static_cast<char*>(memory) + sizeof(SharedFrame));
+
+    // do not let the children flush the parent's buffered output again
+    std::cout << std::flush;
+    std::cerr << std::flush;
+
+    std::vector<pid_t> children;
+    for (int w = 0; w < _workers; ++w)
+    {
+        const pid_t pid = fork();
+        if (pid < 0) break;
+
+        if (pid == 0)
+        {
+            // worker: claim tiles until none are left
+            const RenderStats before = _scene.stats();
+            for (uint32_t t; (t = frame->next_tile++) < _tiles.size(); )
+            {
+                const Region& tile = _tiles[t];
+                Image img(tile.width(), tile.height());
+                _scene.render_region(img, tile.x0, tile.y0, tile.x1, tile.y1, false);
+
+                for (int y = tile.y0; y < tile.y1; ++y)
+                    for (int x = tile.x0; x < tile.x1; ++x)
+                    {
+                        const vec3& c = img(x - tile.x0, y - tile.y0);
+                        double* p = pixels + 3 * (size_t(y - _region.y0) * _region.width() + (x - _region.x0));
+                        p[0] = c[0];
+                        p[1] = c[1];
+                        p[2] = c[2];
+                    }
+            }
+
+            const RenderStats& after = _scene.stats();
+            frame->primary_rays   += after.primary_rays   - before.primary_rays;
+            frame->secondary_rays += after.secondary_rays - before.secondary_rays;
+            frame->hits           += after.hits           - before.hits;
+            _exit(0);
+        }
+
+        children.push_back(pid);
+    }
+
+    // wait for all workers
+    bool failed = children.empty();
+    for (pid_t pid : children)
+    {
+        int status = 0;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed = true;
+    }
+
+    if (!failed)
+    {
+        for (const Region& tile : _tiles)
+            for (int y = tile.y0; y < tile.y1; ++y)
+                for (int x = tile.x0; x < tile.x1; ++x)
+                {
+                    const double* p = pixels + 3 * (size_t(y - _region.y0) * _region.width() + (x - _region.x0));
+                    _img(x - _region.x0, y - _region.y0) = vec3(p[0], p[1], p[2]);
+                }
+
+        RenderStats stats;
+        stats.primary_rays   = frame->primary_rays;
+        stats.secondary_rays = frame->secondary_rays;
+        stats.hits           = frame->hits;
+        _scene.add_stats(stats);
+    }
+
+    frame->~SharedFrame();
+    munmap(memory, bytes);
+
+    if (failed)
+        throw std::runtime_error("A render worker failed");
+}
+
+#endif
+
+
+//-----------------------------------------------------------------------------
+
+
+void render_tiles(Scene& _scene, const Region& _region, const std::vector<Region>& _tiles,
+                  int _workers, Image& _img)
+{
+    _img.resize(_region.width(), _region.height());
+
+    if (_workers > 1)
+    {
+#ifdef _WIN32
+        throw std::runtime_error("Forked render workers are not supported on this platform");
+#else
+        // built once here, the workers inherit them with the address space
+        _scene.prepare_shadow_maps();
+        render_forked(_scene, _region, _tiles, _workers, _img);
+        return;
+#endif
+    }
+
+    // render one tile after the other, each with all threads
+    for (const Region& tile : _tiles)
+    {
+        Image img(tile.width(), tile.height());
+        _scene.render_region(img, tile.x0, tile.y0, tile.x1, tile.y1);
+        copy_tile(tile, img, tile, _img, _region);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool write_shard(const std::string& _filename, int _width, int _height,
+                 const Region& _region, const Image& _img, const std::vector<Region>& _tiles)
+{
+    std::ofstream ofs(_filename, std::ios::binary);
+    if (!ofs) return false;
+
+    const uint32_t header[3] = { uint32_t(_width), uint32_t(_height), uint32_t(_tiles.size()) };
+    ofs.write(SHARD_MAGIC, sizeof(SHARD_MAGIC));
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    std::vector<double> pixels;
+    for (const Region& tile : _tiles)
+    {
+        const int32_t rect[4] = { tile.x0, tile.y0, tile.x1, tile.y1 };
+        ofs.write(reinterpret_cast<const char*>(rect), sizeof(rect));
+
+        pixels.clear();
+        for (int y = tile.y0; y < tile.y1; ++y)
+            for (int x = tile.x0; x < tile.x1; ++x)
+            {
+                const vec3& c = _img(x - _region.x0, y - _region.y0);
+                pixels.push_back(c[0]);
+                pixels.push_back(c[1]);
+                pixels.push_back(c[2]);
+            }
+        ofs.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * sizeof(double));
+    }
+
+    return bool(ofs);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void merge_shard(const std::string& _filename, Image& _img, std::vector<bool>& _covered)
+{
+    std::ifstream ifs(_filename, std::ios::binary);
+    if (!ifs)
+        throw std::runtime_error("Cannot open partial image " + _filename);
+
+    char magic[sizeof(SHARD_MAGIC)];
+    uint32_t header[3];
+    ifs.read(magic, sizeof(magic));
+    ifs.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!ifs || std::memcmp(magic, SHARD_MAGIC, sizeof(magic)) != 0)
+        throw std::runtime_error("Not a partial image: " + _filename);
+
+    const unsigned int width = header[0], height = header[1];
+    if (_img.width() == 0 && _img.height() == 0)
+        _img.resize(width, height);
+    else if (_img.width() != width || _img.height() != height)
+        throw std::runtime_error("Partial image has a different frame size: " + _filename);
+    _covered.resize(size_t(width) * height, false);
+
+    std::vector<double> pixels;
+    for (uint32_t t = 0; t < header[2]; ++t)
+    {
+        int32_t rect[4];
+        ifs.read(reinterpret_cast<char*>(rect), sizeof(rect));
+        if (!ifs || rect[0] < 0 || rect[1] < 0 || rect[0] > rect[2] || rect[1] > rect[3] ||
+            rect[2] > int32_t(width) || rect[3] > int32_t(height))
+            throw std::runtime_error("Invalid tile in partial image " + _filename);
+
+        pixels.resize(3 * size_t(rect[2] - rect[0]) * size_t(rect[3] - rect[1]));
+        ifs.read(reinterpret_cast<char*>(pixels.data()), pixels.size() * sizeof(double));
+        if (!ifs)
+            throw std::runtime_error("Truncated partial image " + _filename);
+
+        const double* p = pixels.data();
+        for (int y = rect[1]; y < rect[3]; ++y)
+            for (int x = rect[0]; x < rect[2]; ++x, p += 3)
+            {
+                std::vector<bool>::reference covered = _covered[size_t(y) * width + x];
+                if (covered)
+                    throw std::runtime_error("Partial image " + _filename + " overlaps an earlier one");
+                covered = true;
+                _img(x, y) = vec3(p[0], p[1], p[2]);
+            }
+    }
+}
+
+
+//=============================================================================
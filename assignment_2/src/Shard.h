@@ -0,0 +1,73 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef SHARD_H
+#define SHARD_H
+
+
+//== INCLUDES =================================================================
+
+#include "Image.h"
+#include "Scene.h"
+
+#include <string>
+#include <vector>
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class Region Shard.h
+/// A rectangle [x0,x1)x[y0,y1) of pixels of the camera image
+struct Region
+{
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+
+    int width()  const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+    bool empty() const { return x1 <= x0 || y1 <= y0; }
+};
+
+
+//== FUNCTIONS ================================================================
+
+
+/// Split \c _region into tiles of at most \c _tile_size pixels per side, in
+/// scanline order.
+std::vector<Region> split_into_tiles(const Region& _region, int _tile_size);
+
+/// The tiles of shard \c _index out of \c _count: tiles are dealt round-robin,
+/// so that expensive parts of the image are spread over all shards.
+std::vector<Region> shard_tiles(const std::vector<Region>& _tiles, int _index, int _count);
+
+/// Render \c _tiles of \c _scene into \c _img, which covers \c _region.
+/// With more than one worker, the tiles are rendered by forked processes
+/// that take tiles from a shared counter and write into a framebuffer in
+/// shared memory (POSIX only, throws std::runtime_error otherwise). The
+/// ray counters of all workers are added to the scene's stats().
+void render_tiles(Scene& _scene, const Region& _region, const std::vector<Region>& _tiles,
+                  int _workers, Image& _img);
+
+/// Write the pixels of \c _tiles from \c _img, which covers \c _region, into
+/// the partial image \c _filename of a \c _width x \c _height frame.
+bool write_shard(const std::string& _filename, int _width, int _height,
+                 const Region& _region, const Image& _img, const std::vector<Region>& _tiles);
+
+/// Copy the tiles of the partial image \c _filename into \c _img. An empty
+/// \c _img is resized to the frame size stored in the file. \c _covered
+/// holds one flag per pixel of the frame and marks the pixels merged so
+/// far; throws std::runtime_error on invalid files, mismatching frame sizes
+/// or tiles that were already merged (e.g. the same shard twice).
+void merge_shard(const std::string& _filename, Image& _img, std::vector<bool>& _covered);
+
+
+//=============================================================================
+#endif // SHARD_H defined
+//=============================================================================
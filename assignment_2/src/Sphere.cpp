@@ -28,10 +28,7 @@ Sphere::Sphere(const vec3& _center, double _radius)
 
 bool
 Sphere::
-intersect(const Ray&  _ray,
-          vec3&       _intersection_point,
-          vec3&       _intersection_normal,
-          double&     _intersection_t) const
+intersect(const Ray& _ray, Hit& _hit) const
 {
 
     const vec3 &dir = _ray.direction;
@@ -42,19 +39,26 @@ intersect(const Ray&  _ray,
                                  2 * dot(dir, oc),
                                  dot(oc, oc) - radius * radius, t);
 
-    _intersection_t = NO_INTERSECTION;
+    _hit.t = NO_INTERSECTION;
 
     // Find the closest valid solution (in front of the viewer)
     for (size_t i = 0; i < nsol; ++i) {
-        if (t[i] > 0) _intersection_t = std::min(_intersection_t, t[i]);
+        if (t[i] > 0) _hit.t = std::min(_hit.t, t[i]);
     }
 
-    if (_intersection_t == NO_INTERSECTION) return false;
+    return (_hit.t != NO_INTERSECTION);
+}
+
+
+//-----------------------------------------------------------------------------
 
-    _intersection_point  = _ray(_intersection_t);
-    _intersection_normal = (_intersection_point - center) / radius;
 
-    return true;
+void
+Sphere::
+surface(const Ray& _ray, const Hit& _hit, vec3& _point, vec3& _normal) const
+{
+    _point  = _ray(_hit.t);
+    _normal = (_point - center) / radius;
 }
 
 //=============================================================================
@@ -14,12 +14,7 @@
 
 //== INCLUDES =================================================================
 
-#ifdef _WIN32
-#  include <windows.h>
-#else // Unix
-#  include <sys/time.h>
-#endif
-
+#include <chrono>
 #include <iostream>
 
 
@@ -28,75 +23,40 @@
 
 /// \class StopWatch StopWatch.h
 /// This class implements a simple stop watch, that you can start() and stop()
-/// and that returns the elapsed() time in milliseconds.
+/// and that returns the elapsed() time in milliseconds. It uses the steady
+/// clock, which is not affected by changes of the system time. To see where
+/// the time goes inside a measurement, use the Profiler.
 class StopWatch
 {
 public:
-    
-    /// Constructor
-    StopWatch()
-	{
-#ifdef _WIN32 // Windows
-		QueryPerformanceFrequency(&freq_);
-#endif
-    }
-    
-    
+
     /// Start time measurement
     void start()
-	{
-#ifdef _WIN32 // Windows
-		QueryPerformanceCounter(&starttime_);
-#else // Linux
-		starttime_ = current_time();
-#endif
+    {
+        starttime_ = Clock::now();
     }
-	
-    
+
+
     /// Stop time measurement, return elapsed time in ms
     double stop()
-	{
-#ifdef _WIN32 // Windows
-		QueryPerformanceCounter(&endtime_);
-#else // Unix
-		endtime_ = current_time();
-#endif
+    {
+        endtime_ = Clock::now();
         return elapsed();
     }
-    
-    
+
+
     /// Return elapsed time in ms (watch has to be stopped).
     double elapsed() const
-	{
-#ifdef _WIN32 // Windows
-		return ((double)(endtime_.QuadPart - starttime_.QuadPart)
-                / (double)freq_.QuadPart * 1000.0f);
-#else // Unix
-		return ((endtime_.tv_sec  - starttime_.tv_sec )*1000.0 +
-                (endtime_.tv_usec - starttime_.tv_usec)*0.001);
-#endif
+    {
+        return std::chrono::duration<double, std::milli>(endtime_ - starttime_).count();
     }
-    
-    
+
+
 private:
-    
-#ifdef _WIN32 // Windows
-    
-	LARGE_INTEGER starttime_, endtime_;
-	LARGE_INTEGER freq_;
-    
-#else // Unix
-    
-	timeval current_time() const
-	{
-		struct timeval tv;
-		gettimeofday(&tv, 0);
-		return tv;
-	}
-    
-	timeval starttime_, endtime_;
-    
-#endif
+
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::time_point starttime_, endtime_;
 };
 
 
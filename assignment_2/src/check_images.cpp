@@ -0,0 +1,330 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== includes =================================================================
+
+#include "StopWatch.h"
+#include "Scene.h"
+
+#include <lodepng.h>
+
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+/// 8 bit RGB image with the top row first
+struct RGBImage
+{
+    unsigned int width = 0, height = 0;
+    std::vector<uint8_t> rgb;
+};
+
+
+/// Quantize a rendered image like Image::write() does. Image rows start at
+/// the bottom (TGA origin), so they are flipped.
+static RGBImage quantize(const Image &_image)
+{
+    RGBImage out;
+    out.width  = _image.width();
+    out.height = _image.height();
+    out.rgb.resize(size_t(out.width) * out.height * 3);
+    for (unsigned int y = 0; y < out.height; ++y)
+        for (unsigned int x = 0; x < out.width; ++x) {
+            const vec3 &color = _image(x, out.height - 1 - y);
+            uint8_t *p = &out.rgb[(size_t(y) * out.width + x) * 3];
+            for (int c = 0; c < 3; ++c)
+                p[c] = static_cast<unsigned char>(255.0 * color[c]);
+        }
+    return out;
+}
+
+
+/// Read an uncompressed 24 bit TGA as written by Image::write()
+static bool read_tga(const std::string &_filename, RGBImage &_image)
+{
+    std::ifstream file(_filename, std::ios::binary);
+    unsigned char header[18];
+    if (!file.read(reinterpret_cast<char *>(header), 18) || header[2] != 2 || header[16] != 24)
+        return false;
+    file.ignore(header[0]);
+    _image.width  = header[12] | (header[13] << 8);
+    _image.height = header[14] | (header[15] << 8);
+    const bool top_first = (header[17] & 0x20) != 0;
+
+    std::vector<uint8_t> bgr(size_t(_image.width) * _image.height * 3);
+    if (!file.read(reinterpret_cast<char *>(bgr.data()), bgr.size())) return false;
+    _image.rgb.resize(bgr.size());
+    for (unsigned int y = 0; y < _image.height; ++y) {
+        const unsigned int row = top_first ? y : _image.height - 1 - y;
+        for (unsigned int x = 0; x < _image.width; ++x)
+            for (int c = 0; c < 3; ++c)
+                _image.rgb[(size_t(y) * _image.width + x) * 3 + c] =
+                    bgr[(size_t(row) * _image.width + x) * 3 + 2 - c];
+    }
+    return true;
+}
+
+
+/// Write \c _image as PNG
+static bool write_png(const std::string &_filename, const RGBImage &_image)
+{
+    return lodepng::encode(_filename, _image.rgb, _image.width, _image.height, LCT_RGB, 8) == 0;
+}
+
+
+/// Read a reference image in PNG or TGA format
+static bool read_image(const std::string &_filename, RGBImage &_image)
+{
+    if (_filename.size() > 4 && _filename.compare(_filename.size() - 4, 4, ".png") == 0)
+        return lodepng::decode(_image.rgb, _image.width, _image.height, _filename, LCT_RGB, 8) == 0;
+    return read_tga(_filename, _image);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Differences between a rendered image and its reference
+struct Comparison
+{
+    /// peak signal-to-noise ratio over all channels in dB (infinite if equal)
+    double psnr = std::numeric_limits<double>::infinity();
+    /// largest difference of a channel (0..255)
+    int max_error = 0;
+    /// fraction of the pixels that differ in any channel
+    double differing = 0.0;
+};
+
+
+/// Compare \c _image to \c _reference (of the same size) and store the
+/// amplified differences in \c _diff
+static Comparison compare(const RGBImage &_image, const RGBImage &_reference, Image &_diff)
+{
+    Comparison result;
+    const size_t pixels = size_t(_image.width) * _image.height;
+    double squared = 0.0;
+    size_t differing = 0;
+    _diff.resize(_image.width, _image.height);
+    for (size_t i = 0; i < pixels; ++i) {
+        vec3 d;
+        int pixel_error = 0;
+        for (int c = 0; c < 3; ++c) {
+            const int e = std::abs(int(_image.rgb[3 * i + c]) - int(_reference.rgb[3 * i + c]));
+            squared += double(e) * e;
+            pixel_error = std::max(pixel_error, e);
+            d[c] = std::min(1.0, 8.0 * e / 255.0);
+        }
+        result.max_error = std::max(result.max_error, pixel_error);
+        differing += (pixel_error > 0);
+        const unsigned int x = i % _image.width, y = unsigned(i / _image.width);
+        _diff(x, _image.height - 1 - y) = d;
+    }
+    if (squared > 0.0)
+        result.psnr = 10.0 * std::log10(255.0 * 255.0 / (squared / (3.0 * pixels)));
+    result.differing = double(differing) / pixels;
+    return result;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Program entry point: render the bundled scenes and compare them to
+/// reference images, so that optimizations that change the output are
+/// noticed. Exits with 1 if any scene fails.
+int main(int argc, char **argv) {
+    std::string scenesDir   = "../scenes";
+    std::string expectedDir = "../golden_results";
+    std::string diffDir, outputDir, csvFile;
+    double minPsnr  = 45.0;
+    int    maxError = 8;
+    double maxDiffering = 0.1;
+    bool   frustumCulling = true;
+    int    shadowMapResolution = 0;
+    bool   update = false;
+    bool   badOption = false;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        if      (arg == "--scenes"   && i + 1 < argc) scenesDir   = argv[++i];
+        else if (arg == "--expected" && i + 1 < argc) expectedDir = argv[++i];
+        else if (arg == "--diff"     && i + 1 < argc) diffDir     = argv[++i];
+        else if (arg == "--output"   && i + 1 < argc) outputDir   = argv[++i];
+        else if (arg == "--csv"      && i + 1 < argc) csvFile     = argv[++i];
+        else if (arg == "--min-psnr" && i + 1 < argc) minPsnr     = atof(argv[++i]);
+        else if (arg == "--max-error" && i + 1 < argc) {
+            maxError = atoi(argv[++i]);
+            if (maxError < 0 || maxError > 255) badOption = true;
+        }
+        else if (arg == "--max-differing" && i + 1 < argc) {
+            maxDiffering = atof(argv[++i]);
+            if (maxDiffering < 0.0 || maxDiffering > 100.0) badOption = true;
+        }
+        else if (arg == "--update") update = true;
+        else if (arg == "--no-culling") frustumCulling = false;
+        else if (arg == "--shadow-maps" && i + 1 < argc) {
+            shadowMapResolution = atoi(argv[++i]);
+            if (shadowMapResolution < 1) badOption = true;
+        }
+        else if (arg.compare(0, 2, "--") == 0) badOption = true;
+        else names.push_back(arg);
+    }
+    if (badOption) {
+        std::cerr << "Usage: " << argv[0] << " [options] [scene...]\n";
+        std::cerr << "Renders the bundled scenes (or the named ones) and compares them to\n";
+        std::cerr << "<expected>/<scene>.png or <expected>/<scene>.tga.\n";
+        std::cerr << "Options:\n";
+        std::cerr << "  --scenes DIR       scene directories (default ../scenes)\n";
+        std::cerr << "  --expected DIR     reference images (default ../golden_results)\n";
+        std::cerr << "  --diff DIR         where to write <scene>_diff.tga for scenes that\n";
+        std::cerr << "                     differ, 8x amplified (default: none)\n";
+        std::cerr << "  --output DIR       also write the renders as <scene>.tga, e.g. as\n";
+        std::cerr << "                     references for a later run\n";
+        std::cerr << "  --update           write the renders as <expected>/<scene>.png instead\n";
+        std::cerr << "                     of comparing them\n";
+        std::cerr << "  --csv F            write the results with load and render times to F\n";
+        std::cerr << "  --min-psnr DB      fail below this PSNR (default 45)\n";
+        std::cerr << "  --max-error E      fail if a channel differs by more than E (default 8)\n";
+        std::cerr << "  --max-differing P  fail if more than P percent of the pixels differ\n";
+        std::cerr << "                     (default 0.1)\n";
+        std::cerr << "  --no-culling       render without frustum culling\n";
+        std::cerr << "  --shadow-maps R    render with cube shadow maps of RxR texels per face\n";
+        std::cerr << std::flush;
+        exit(1);
+    }
+    if (names.empty())
+        names = { "spheres", "cylinders", "combo", "molecule", "molecule2", "cube",
+                  "mask", "mirror", "toon_faces", "office", "rings" };
+
+    // one row of the summary per scene, printed after all scenes since
+    // loading prints messages of its own
+    struct Row {
+        std::string name, status;
+        Comparison result;
+        double load = 0.0, render = 0.0;
+        bool compared = false;
+    };
+    std::vector<Row> rows;
+
+    int failed = 0;
+    for (const std::string &name : names) {
+        std::cout << "Check scene '" << name << "'...\n" << std::flush;
+        rows.push_back(Row());
+        Row &row = rows.back();
+        row.name = name;
+
+        RGBImage reference;
+        if (!update &&
+            !read_image(expectedDir + "/" + name + ".png", reference) &&
+            !read_image(expectedDir + "/" + name + ".tga", reference)) {
+            row.status = "FAILED (no reference image in " + expectedDir + ")";
+            ++failed;
+            continue;
+        }
+
+        StopWatch load, render;
+        Image image;
+        try {
+            load.start();
+            Scene scene(scenesDir + "/" + name + "/" + name + ".sce");
+            scene.set_frustum_culling(frustumCulling);
+            if (shadowMapResolution) scene.set_shadow_maps(shadowMapResolution);
+            load.stop();
+            render.start();
+            image = scene.render();
+            render.stop();
+        }
+        catch (const std::exception &e) {
+            row.status = std::string("FAILED (") + e.what() + ")";
+            ++failed;
+            continue;
+        }
+        row.load   = load.elapsed();
+        row.render = render.elapsed();
+        if (!outputDir.empty() && !image.write(outputDir + "/" + name + ".tga"))
+            std::cerr << "Cannot write " << outputDir << "/" << name << ".tga\n";
+
+        const RGBImage rendered = quantize(image);
+        if (update) {
+            const std::string path = expectedDir + "/" + name + ".png";
+            const bool written = write_png(path, rendered);
+            row.status = (written ? "updated " : "FAILED (cannot write ") + path + (written ? "" : ")");
+            failed += !written;
+            continue;
+        }
+
+        if (rendered.width != reference.width || rendered.height != reference.height) {
+            row.status = "FAILED (size differs)";
+            ++failed;
+            continue;
+        }
+        Image diff;
+        row.result   = compare(rendered, reference, diff);
+        row.compared = true;
+        const bool pass = row.result.psnr >= minPsnr && row.result.max_error <= maxError &&
+                          100.0 * row.result.differing <= maxDiffering;
+        row.status = pass ? "ok" : "FAILED";
+        failed += !pass;
+        if (!diffDir.empty() && row.result.max_error > 0 &&
+            !diff.write(diffDir + "/" + name + "_diff.tga"))
+            std::cerr << "Cannot write " << diffDir << "/" << name << "_diff.tga\n";
+    }
+
+    std::cout << "\n" << std::left << std::setw(12) << "scene" << std::right
+              << std::setw(9) << "PSNR" << std::setw(8) << "max"
+              << std::setw(10) << "differ" << std::setw(11) << "load"
+              << std::setw(11) << "render" << "  result\n" << std::fixed;
+    for (const Row &row : rows) {
+        std::cout << std::left << std::setw(12) << row.name << std::right;
+        if (row.compared)
+            std::cout << std::setprecision(1) << std::setw(9) << row.result.psnr
+                      << std::setw(8) << row.result.max_error
+                      << std::setprecision(2) << std::setw(9) << 100.0 * row.result.differing << "%";
+        else
+            std::cout << std::setw(27) << "";
+        std::cout << std::setprecision(1) << std::setw(8) << row.load << " ms"
+                  << std::setw(8) << row.render << " ms  " << row.status << "\n";
+    }
+    std::cout << (failed ? std::to_string(failed) + " of " + std::to_string(names.size()) + " scenes failed\n"
+                         : (update ? "references updated\n" : "all scenes match\n"));
+
+    if (!csvFile.empty()) {
+        std::ofstream csv(csvFile);
+        csv << "scene,psnr,max_error,differing,load_ms,render_ms,result\n";
+        for (const Row &row : rows) {
+            csv << row.name << ",";
+            if (row.compared)
+                csv << std::setprecision(6) << std::defaultfloat << row.result.psnr << ","
+                    << row.result.max_error << "," << row.result.differing;
+            else
+                csv << ",,";
+            csv << "," << row.load << "," << row.render << "," << row.status << "\n";
+        }
+        if (!csv)
+            std::cerr << "Cannot write " << csvFile << "\n";
+    }
+
+    return failed ? 1 : 0;
+}
+
+
+//=============================================================================
@@ -0,0 +1,41 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== includes =================================================================
+
+#include "Scene.h"
+#include "StopWatch.h"
+
+#include <iostream>
+#include <string>
+
+/// Program entry point: parse a scene, load its meshes and build their BVHs,
+/// and write everything into a compiled scene that raytrace maps directly.
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " input.sce output.rts\n";
+        std::cerr << std::flush;
+        exit(1);
+    }
+
+    StopWatch timer;
+    std::cout << "Read scene '" << argv[1] << "'..." << std::flush;
+    timer.start();
+    Scene scene(argv[1]);
+    timer.stop();
+    std::cout << "\ndone (" << timer << ")\n";
+
+    std::cout << "Write compiled scene '" << argv[2] << "'..." << std::flush;
+    if (!scene.write_compiled(argv[2])) {
+        std::cerr << "\nCannot write " << argv[2] << "\n";
+        exit(1);
+    }
+    std::cout << "done\n";
+}
@@ -0,0 +1,386 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== includes =================================================================
+
+#include "vec3.h"
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+/// Random numbers that are the same on every platform for the same seed
+/// (the distributions of <random> are implementation defined, the engine
+/// is not).
+class Random
+{
+public:
+    explicit Random(uint64_t _seed) : engine_(_seed) {}
+
+    /// uniform in [0,1)
+    double uniform() { return (engine_() >> 11) * (1.0 / 9007199254740992.0); }
+
+    /// uniform in [_lo,_hi)
+    double uniform(double _lo, double _hi) { return _lo + (_hi - _lo) * uniform(); }
+
+    /// standard normal distribution (Box-Muller)
+    double normal()
+    {
+        const double u = 1.0 - uniform(), v = uniform();
+        return std::sqrt(-2.0 * std::log(u)) * std::cos(2.0 * M_PI * v);
+    }
+
+    /// a saturated random color
+    vec3 color()
+    {
+        vec3 c(uniform(), uniform(), uniform());
+        const double m = std::max(c[0], std::max(c[1], c[2]));
+        return m > 0.0 ? c / m : vec3(1.0);
+    }
+
+private:
+    std::mt19937_64 engine_;
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+/// How object positions are distributed in the scene's box
+enum Distribution { UNIFORM, CLUSTERED, PLANAR };
+
+
+/// Draws object positions in the box [-extent,extent] x [0,2 extent] x
+/// [-extent,extent] above the ground plane y = 0
+class Placement
+{
+public:
+    Placement(Distribution _distribution, double _extent, int _clusters, Random &_random)
+    : distribution_(_distribution), extent_(_extent), random_(_random)
+    {
+        for (int i = 0; i < _clusters; ++i)
+            centers_.push_back(inside(0.0));
+    }
+
+    /// the position of an object of size \c _radius
+    vec3 next(double _radius)
+    {
+        switch (distribution_) {
+            case PLANAR: {
+                vec3 p = inside(_radius);
+                p[1] = _radius;
+                return p;
+            }
+            case CLUSTERED: {
+                const vec3 &c = centers_[size_t(random_.uniform() * centers_.size())];
+                const double sigma = 0.1 * extent_;
+                vec3 p = c + sigma * vec3(random_.normal(), random_.normal(), random_.normal());
+                for (int k = 0; k < 3; ++k) {
+                    const double lo = (k == 1) ? _radius : -extent_ + _radius;
+                    const double hi = (k == 1) ? 2.0 * extent_ - _radius : extent_ - _radius;
+                    p[k] = std::min(std::max(p[k], lo), hi);
+                }
+                return p;
+            }
+            default:
+                return inside(_radius);
+        }
+    }
+
+private:
+    /// uniform inside the box shrunk by \c _margin
+    vec3 inside(double _margin)
+    {
+        return vec3(random_.uniform(-extent_ + _margin, extent_ - _margin),
+                    random_.uniform(_margin, 2.0 * extent_ - _margin),
+                    random_.uniform(-extent_ + _margin, extent_ - _margin));
+    }
+
+    Distribution      distribution_;
+    double            extent_;
+    Random           &random_;
+    std::vector<vec3> centers_;
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+/// A closed, bumpy sphere of radius about \c _radius around the origin with
+/// about \c _triangles triangles
+struct Blob
+{
+    std::vector<vec3> vertices;
+    std::vector<int>  triangles;
+
+    Blob(size_t _triangles, double _radius)
+    {
+        // rings of latitude (without the poles) and segments of longitude,
+        // 2 * segments * (rings - 1) triangles
+        const int rings    = std::max(2, int(std::lround(std::sqrt(_triangles / 4.0))) + 1);
+        const int segments = std::max(3, int(std::lround(double(_triangles) / (2.0 * (rings - 1)))));
+
+        auto point = [&](double _theta, double _phi) {
+            const double r = _radius * (1.0 + 0.08 * std::sin(5.0 * _theta) * std::sin(7.0 * _phi));
+            return vec3(r * std::sin(_theta) * std::cos(_phi), r * std::cos(_theta),
+                        r * std::sin(_theta) * std::sin(_phi));
+        };
+        vertices.push_back(vec3(0.0, _radius, 0.0));
+        for (int i = 1; i < rings; ++i)
+            for (int j = 0; j < segments; ++j)
+                vertices.push_back(point(M_PI * i / rings, 2.0 * M_PI * j / segments));
+        vertices.push_back(vec3(0.0, -_radius, 0.0));
+
+        const int south = int(vertices.size()) - 1;
+        auto ring = [&](int _i, int _j) { return 1 + (_i - 1) * segments + (_j % segments); };
+        for (int j = 0; j < segments; ++j) {
+            add(0, ring(1, j + 1), ring(1, j));
+            add(south, ring(rings - 1, j), ring(rings - 1, j + 1));
+        }
+        for (int i = 1; i + 1 < rings; ++i)
+            for (int j = 0; j < segments; ++j) {
+                add(ring(i, j), ring(i, j + 1), ring(i + 1, j));
+                add(ring(i, j + 1), ring(i + 1, j + 1), ring(i + 1, j));
+            }
+    }
+
+    size_t num_triangles() const { return triangles.size() / 3; }
+
+    /// write the blob translated by \c _offset in OFF format
+    bool write(const std::string &_filename, const vec3 &_offset) const
+    {
+        std::ofstream ofs(_filename);
+        ofs.precision(9);
+        ofs << "OFF\n" << vertices.size() << " " << num_triangles() << " 0\n";
+        for (const vec3 &v : vertices) {
+            const vec3 p = v + _offset;
+            ofs << p[0] << " " << p[1] << " " << p[2] << "\n";
+        }
+        for (size_t t = 0; t < triangles.size(); t += 3)
+            ofs << "3 " << triangles[t] << " " << triangles[t + 1] << " " << triangles[t + 2] << "\n";
+        return bool(ofs);
+    }
+
+private:
+    void add(int _a, int _b, int _c)
+    {
+        triangles.push_back(_a);
+        triangles.push_back(_b);
+        triangles.push_back(_c);
+    }
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+/// write a Phong material with ambient and diffuse \c _color
+static void write_material(std::ostream &_os, const vec3 &_color)
+{
+    _os << "  " << _color[0] << " " << _color[1] << " " << _color[2]
+        << "  " << _color[0] << " " << _color[1] << " " << _color[2]
+        << "  0.5 0.5 0.5  50  0\n";
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Program entry point: write a scene of controlled size for measuring how
+/// loading, memory and rendering scale with the number of primitives.
+int main(int argc, char **argv) {
+    uint64_t seed = 1;
+    size_t spheres = 0, cylinders = 0, meshTriangles = 0;
+    int gridX = 0, gridZ = 0, lights = 1, clusters = 16;
+    int width = 500, height = 500;
+    double extent = 10.0, size = 0.0;
+    Distribution distribution = UNIFORM;
+    bool badOption = false;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        if      (arg == "--seed"      && i + 1 < argc) seed      = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--spheres"   && i + 1 < argc) spheres   = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--cylinders" && i + 1 < argc) cylinders = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--mesh"      && i + 1 < argc) meshTriangles = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--grid"      && i + 2 < argc) {
+            gridX = atoi(argv[++i]);
+            gridZ = atoi(argv[++i]);
+            if (gridX < 1 || gridZ < 1) badOption = true;
+        }
+        else if (arg == "--lights"    && i + 1 < argc) {
+            lights = atoi(argv[++i]);
+            if (lights < 0) badOption = true;
+        }
+        else if (arg == "--distribution" && i + 1 < argc) {
+            const std::string d(argv[++i]);
+            if      (d == "uniform")   distribution = UNIFORM;
+            else if (d == "clustered") distribution = CLUSTERED;
+            else if (d == "planar")    distribution = PLANAR;
+            else badOption = true;
+        }
+        else if (arg == "--clusters" && i + 1 < argc) {
+            clusters = atoi(argv[++i]);
+            if (clusters < 1) badOption = true;
+        }
+        else if (arg == "--extent" && i + 1 < argc) {
+            extent = atof(argv[++i]);
+            if (extent <= 0.0) badOption = true;
+        }
+        else if (arg == "--size" && i + 1 < argc) {
+            size = atof(argv[++i]);
+            if (size <= 0.0) badOption = true;
+        }
+        else if (arg == "--image" && i + 2 < argc) {
+            width  = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+            if (width < 1 || height < 1) badOption = true;
+        }
+        else if (arg.compare(0, 2, "--") == 0) badOption = true;
+        else args.push_back(arg);
+    }
+    if (gridX && !meshTriangles) badOption = true;
+    if (badOption || args.size() != 1) {
+        std::cerr << "Usage: " << argv[0] << " [options] output.sce\n";
+        std::cerr << "Writes a scene with a ground plane and the given primitives, and its\n";
+        std::cerr << "meshes as output_mesh*.off next to it.\n";
+        std::cerr << "Options:\n";
+        std::cerr << "  --spheres N           N random spheres\n";
+        std::cerr << "  --cylinders N         N random cylinders\n";
+        std::cerr << "  --mesh M              a bumpy sphere mesh of about M triangles\n";
+        std::cerr << "  --grid X Z            X x Z copies of this mesh on a grid on the ground\n";
+        std::cerr << "                        (one OFF file each, scenes have no instancing)\n";
+        std::cerr << "  --lights K            K lights above the scene (default 1)\n";
+        std::cerr << "  --distribution D      placement of spheres, cylinders and the single\n";
+        std::cerr << "                        mesh: uniform (default), clustered or planar\n";
+        std::cerr << "  --clusters C          number of clusters (default 16)\n";
+        std::cerr << "  --extent E            objects lie in [-E,E] x [0,2E] x [-E,E] (default 10)\n";
+        std::cerr << "  --size S              sphere and cylinder radius (default: such that\n";
+        std::cerr << "                        the objects fill about 5% of the box)\n";
+        std::cerr << "  --image W H           image size (default 500 500)\n";
+        std::cerr << "  --seed S              random seed (default 1), the same seed gives the\n";
+        std::cerr << "                        same scene on every platform\n";
+        std::cerr << std::flush;
+        exit(1);
+    }
+
+    const std::string scenePath = args[0];
+    const size_t slash = scenePath.find_last_of('/');
+    const std::string directory = (slash == std::string::npos) ? "" : scenePath.substr(0, slash + 1);
+    const size_t dot = scenePath.find_last_of('.');
+    const std::string stem = scenePath.substr(slash + 1, (dot == std::string::npos || dot < slash + 1)
+                                                         ? std::string::npos : dot - slash - 1);
+
+    Random random(seed);
+    Placement placement(distribution, extent, clusters, random);
+
+    // primitives of equal radius filling about 5% of the box volume
+    const size_t primitives = std::max<size_t>(1, spheres + cylinders);
+    const double radius = size > 0.0 ? size
+                                     : std::cbrt(0.05 * 8.0 * extent * extent * extent * 3.0 / (4.0 * M_PI * primitives));
+
+    std::ofstream sce(scenePath);
+    if (!sce) {
+        std::cerr << "Cannot write " << scenePath << "\n";
+        exit(1);
+    }
+    sce.precision(7);
+    sce << "# generated by gen_scene (seed " << seed << ")\n\n";
+    sce << "# camera: eye, center, up, fovy, width, height\n";
+    sce << "camera  0 " << 1.6 * extent << " " << 3.2 * extent << "  0 " << 0.7 * extent
+        << " 0  0 1 0  45  " << width << " " << height << "\n\n";
+    sce << "depth  1\nbackground 0.5 0.7 1.0\nambience   0.2 0.2 0.2\n\n";
+
+    sce << "# lights: position and color\n";
+    for (int i = 0; i < lights; ++i) {
+        const double phi = 2.0 * M_PI * (i + random.uniform()) / lights;
+        const double intensity = 0.8 / lights;
+        sce << "light  " << 2.0 * extent * std::cos(phi) << " " << 4.0 * extent << " "
+            << 2.0 * extent * std::sin(phi) << "  "
+            << intensity << " " << intensity << " " << intensity << "\n";
+    }
+
+    sce << "\n# ground plane\nplane  0 0 0  0 1 0";
+    write_material(sce, vec3(0.4, 0.4, 0.4));
+
+    if (spheres) sce << "\n# spheres: center, radius, material\n";
+    for (size_t i = 0; i < spheres; ++i) {
+        const vec3 p = placement.next(radius);
+        sce << "sphere  " << p[0] << " " << p[1] << " " << p[2] << "  " << radius;
+        write_material(sce, random.color());
+    }
+
+    if (cylinders) sce << "\n# cylinders: center, radius, axis, height, material\n";
+    for (size_t i = 0; i < cylinders; ++i) {
+        const vec3 p = placement.next(radius);
+        const vec3 axis = normalize(vec3(random.normal(), random.normal(), random.normal()));
+        sce << "cylinder  " << p[0] << " " << p[1] << " " << p[2] << "  " << 0.5 * radius << "  "
+            << axis[0] << " " << axis[1] << " " << axis[2] << "  " << radius;
+        write_material(sce, random.color());
+    }
+
+    size_t triangles = 0, files = 0;
+    if (meshTriangles) {
+        sce << "\n# meshes: filename, shading, material\n";
+        if (!gridX) {
+            const Blob blob(meshTriangles, 0.25 * extent);
+            const vec3 p = placement.next(0.25 * extent);
+            const std::string name = stem + "_mesh.off";
+            if (!blob.write(directory + name, p)) {
+                std::cerr << "Cannot write " << directory << name << "\n";
+                exit(1);
+            }
+            sce << "mesh " << name << " PHONG";
+            write_material(sce, random.color());
+            triangles += blob.num_triangles();
+            ++files;
+        }
+        else {
+            // the cells of the grid cover the ground of the box
+            const double cell = 2.0 * extent / std::max(gridX, gridZ);
+            const Blob blob(meshTriangles, 0.4 * cell);
+            for (int i = 0; i < gridX; ++i)
+                for (int k = 0; k < gridZ; ++k) {
+                    const vec3 p(-0.5 * cell * gridX + (i + 0.5) * cell, 0.4 * cell,
+                                 -0.5 * cell * gridZ + (k + 0.5) * cell);
+                    const std::string name = stem + "_mesh_" + std::to_string(i) + "_" + std::to_string(k) + ".off";
+                    if (!blob.write(directory + name, p)) {
+                        std::cerr << "Cannot write " << directory << name << "\n";
+                        exit(1);
+                    }
+                    sce << "mesh " << name << " PHONG";
+                    write_material(sce, random.color());
+                    triangles += blob.num_triangles();
+                    ++files;
+                }
+        }
+    }
+
+    if (!sce) {
+        std::cerr << "Cannot write " << scenePath << "\n";
+        exit(1);
+    }
+    std::cout << "Wrote " << scenePath << ": " << spheres << " spheres, " << cylinders
+              << " cylinders, " << triangles << " triangles in " << files << " meshes, "
+              << lights << " lights\n";
+}
+
+
+//=============================================================================
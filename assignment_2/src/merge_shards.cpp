@@ -0,0 +1,63 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== includes =================================================================
+
+#include "Shard.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/// Program entry point: combine the partial images written by
+/// `raytrace --shard i/N` into one TGA image. Fails if the partial images
+/// overlap or, unless --partial is given, leave pixels uncovered.
+int main(int argc, char **argv) {
+    int first = 1;
+    bool partial = false;
+    if (argc > 1 && std::string(argv[1]) == "--partial") {
+        partial = true;
+        ++first;
+    }
+    if (argc - first < 2) {
+        std::cerr << "Usage: " << argv[0] << " [--partial] output.tga part.shard...\n";
+        std::cerr << "  --partial   allow pixels that no partial image covers (left black),\n";
+        std::cerr << "              e.g. for renders of a --region\n";
+        std::cerr << std::flush;
+        exit(1);
+    }
+
+    Image image;
+    std::vector<bool> covered;
+    try {
+        for (int i = first + 1; i < argc; ++i)
+            merge_shard(argv[i], image, covered);
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        exit(1);
+    }
+
+    const size_t missing = std::count(covered.begin(), covered.end(), false);
+    if (missing && !partial) {
+        std::cerr << missing << " of " << covered.size() << " pixels are not covered"
+                  << " (missing shards?)\n";
+        exit(1);
+    }
+
+    std::cout << "Write image...";
+    if (!image.write(argv[first])) {
+        std::cerr << "\nCannot write " << argv[first] << "\n";
+        exit(1);
+    }
+    std::cout << "done\n";
+}
@@ -0,0 +1,56 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== includes =================================================================
+
+#include "Mesh.h"
+#include "StopWatch.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+/// Program entry point: convert an OFF mesh into the packed out-of-core
+/// format, which can then be referenced from scene files like an OFF file.
+/// The mesh is streamed through scratch files, so it does not have to fit
+/// into memory.
+int main(int argc, char **argv) {
+    size_t chunkSize = Mesh::PACK_CHUNK_SIZE;
+    std::vector<std::string> args;
+    bool badOption = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        if (arg == "--chunk" && i + 1 < argc) {
+            const long long n = atoll(argv[++i]);
+            if (n < 1) badOption = true;
+            chunkSize = size_t(n);
+        }
+        else if (arg.compare(0, 2, "--") == 0) badOption = true;
+        else args.push_back(arg);
+    }
+    if (badOption || args.size() != 2) {
+        std::cerr << "Usage: " << argv[0] << " [--chunk N] input.off output.rtm\n";
+        std::cerr << "  --chunk N   build the BVH in spatial chunks of about N triangles\n";
+        std::cerr << "              (default " << Mesh::PACK_CHUNK_SIZE << "), which bounds the memory\n";
+        std::cerr << std::flush;
+        exit(1);
+    }
+
+    StopWatch timer;
+    timer.start();
+    std::cout << "Pack mesh '" << args[0] << "'..." << std::flush;
+    if (!Mesh::pack(args[0], args[1], chunkSize)) {
+        std::cerr << "\nCannot pack " << args[0] << " into " << args[1] << "\n";
+        exit(1);
+    }
+    timer.stop();
+    std::cout << "\ndone (" << timer << ")\n";
+}
@@ -12,11 +12,22 @@
 
 #include "StopWatch.h"
 #include "Scene.h"
+#include "Mesh.h"
+#include "ResourceUsage.h"
+#include "MemoryReport.h"
+#include "LogStream.h"
+#include "Profiler.h"
+#include "Shard.h"
 
 #include <vector>
+#include <memory>
+#include <future>
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
 
 /// Program entry point.
 int main(int argc, char **argv) {
@@ -24,9 +35,94 @@ int main(int argc, char **argv) {
     struct RaytraceJob { std::string scenePath, outPath; };
     std::vector<RaytraceJob> jobs;
 
-    if (argc == 3)
+    // Strip options from the positional arguments
+    bool reorderRays = false;
+    bool frustumCulling = true;
+    double minContribution = 0.0;
+    bool russianRoulette = false;
+    int shadowMapResolution = 0;
+    double shadowBias = -1.0;
+    int areaLightSamples = 4;
+    Region region;
+    bool hasRegion = false;
+    int shardIndex = 0, shardCount = 1, workers = 1;
+    double timeBudget = 0.0;
+    int frames = 1;
+    bool memoryReport = false;
+    std::string memoryJson;
+    bool profile = false;
+    std::string traceFile;
+    bool pipeline = true;
+    double pipelineMemory = 0.0;
+    bool badOption = false;
+    std::vector<char *> args;
+    for (int i = 0; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        if (arg == "--coherent") reorderRays = true;
+        else if (arg == "--no-culling") frustumCulling = false;
+        else if (arg == "--russian-roulette") russianRoulette = true;
+        else if (arg == "--min-contribution" && i + 1 < argc) {
+            minContribution = atof(argv[++i]);
+            if (minContribution < 0.0 || minContribution > 1.0) badOption = true;
+        }
+        else if (arg == "--shadow-maps" && i + 1 < argc) {
+            shadowMapResolution = atoi(argv[++i]);
+            if (shadowMapResolution < 1) badOption = true;
+        }
+        else if (arg == "--shadow-bias" && i + 1 < argc) {
+            shadowBias = atof(argv[++i]);
+            if (shadowBias < 0.0) badOption = true;
+        }
+        else if (arg == "--area-samples" && i + 1 < argc) {
+            areaLightSamples = atoi(argv[++i]);
+            if (areaLightSamples < 1) badOption = true;
+        }
+        else if (arg == "--region" && i + 4 < argc) {
+            region.x0 = atoi(argv[++i]);
+            region.y0 = atoi(argv[++i]);
+            region.x1 = atoi(argv[++i]);
+            region.y1 = atoi(argv[++i]);
+            hasRegion = true;
+        }
+        else if (arg == "--shard" && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d/%d", &shardIndex, &shardCount) != 2 ||
+                shardCount < 1 || shardIndex < 0 || shardIndex >= shardCount)
+                badOption = true;
+        }
+        else if (arg == "--workers" && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+            if (workers < 1) badOption = true;
+        }
+        else if (arg == "--time-budget-ms" && i + 1 < argc) {
+            timeBudget = atof(argv[++i]);
+            if (timeBudget <= 0.0) badOption = true;
+        }
+        else if (arg == "--frames" && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+            if (frames < 1) badOption = true;
+        }
+        else if (arg == "--memory") memoryReport = true;
+        else if (arg == "--memory-json" && i + 1 < argc) memoryJson = argv[++i];
+        else if (arg == "--profile") profile = true;
+        else if (arg == "--trace" && i + 1 < argc) traceFile = argv[++i];
+        else if (arg == "--no-pipeline") pipeline = false;
+        else if (arg == "--pipeline-memory-mb" && i + 1 < argc) {
+            pipelineMemory = atof(argv[++i]);
+            if (pipelineMemory <= 0.0) badOption = true;
+        }
+        else if (arg.compare(0, 2, "--") == 0) badOption = true;
+        else args.push_back(argv[i]);
+    }
+    argc = int(args.size());
+    argv = args.data();
+    const bool sharded = hasRegion || shardCount > 1 || workers > 1;
+    const bool progressive = timeBudget > 0.0;
+    if (sharded && progressive) badOption = true;
+    if (frames > 1 && (sharded || progressive)) badOption = true;
+
+    if (!badOption && argc == 3)
         jobs.emplace_back(RaytraceJob{argv[1], argv[2]});
-    else if ((argc == 2) && argv[1][0] == '0') {
+    else if (!badOption && (argc == 2) && argv[1][0] == '0') {
         jobs = { {
             {"../scenes/spheres/spheres.sce",       "spheres.tga"},
             {"../scenes/cylinders/cylinders.sce",   "cylinders.tga"},
@@ -41,27 +137,263 @@ int main(int argc, char **argv) {
             {"../scenes/rings/rings.sce",           "rings.tga"}
         } };
     }
-    else {
-        std::cerr << "Usage: " << argv[0] << " input.sce output.tga\n";
-        std::cerr << "Or: " << argv[0] << " 0\n";
+    if (!memoryJson.empty() && jobs.size() > 1) jobs.clear();
+    if (jobs.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [options] input.sce output.tga\n";
+        std::cerr << "Or: " << argv[0] << " [options] 0\n";
+        std::cerr << "Options:\n";
+        std::cerr << "  --coherent            trace reflected rays in sorted per-tile batches\n";
+        std::cerr << "  --no-culling          test all objects for primary rays instead of the\n";
+        std::cerr << "                        objects inside each tile's frustum\n";
+        std::cerr << "  --min-contribution C  stop reflections that contribute less than C\n";
+        std::cerr << "                        to the pixel color (default 0)\n";
+        std::cerr << "  --russian-roulette    continue such reflections randomly instead\n";
+        std::cerr << "  --shadow-maps R       preview: look up shadows in cube shadow maps with\n";
+        std::cerr << "                        RxR texels per face instead of tracing shadow rays\n";
+        std::cerr << "  --shadow-bias B       relative depth tolerance of these lookups\n";
+        std::cerr << "                        (default 4/R)\n";
+        std::cerr << "  --area-samples N      trace up to NxN shadow rays per area light and\n";
+        std::cerr << "                        shading point (default 4)\n";
+        std::cerr << "  --region x0 y0 x1 y1  only render the pixels [x0,x1)x[y0,y1)\n";
+        std::cerr << "  --shard i/N           render every N-th tile starting at tile i and write\n";
+        std::cerr << "                        a partial image, to be combined with merge_shards\n";
+        std::cerr << "  --workers N           render tiles with N forked processes\n";
+        std::cerr << "  --time-budget-ms T    render progressively and stop refining after T ms\n";
+        std::cerr << "                        (cannot be combined with --region/--shard/--workers)\n";
+        std::cerr << "  --frames N            render N frames of the morph mesh animation to\n";
+        std::cerr << "                        output_0000.tga, ... (cannot be combined with the above)\n";
+        std::cerr << "  --memory              print the memory used per object and category and\n";
+        std::cerr << "                        the resident set after loading and rendering\n";
+        std::cerr << "  --memory-json F       write this report to the JSON file F (one scene only)\n";
+        std::cerr << "  --profile             print the time spent in each phase (parsing, mesh\n";
+        std::cerr << "                        loading, BVH builds, tiles, ...) per scene\n";
+        std::cerr << "  --trace F             write the phases of all scenes to F as Chrome trace\n";
+        std::cerr << "                        JSON (chrome://tracing, ui.perfetto.dev)\n";
+        std::cerr << "  --no-pipeline         render several scenes strictly one after another\n";
+        std::cerr << "                        instead of loading the next scene and writing the\n";
+        std::cerr << "                        previous image during a render\n";
+        std::cerr << "  --pipeline-memory-mb M  only load the next scene during a render while\n";
+        std::cerr << "                        the resident set is below M MB\n";
         std::cerr << std::flush;
         exit(1);
     }
 
-    for (const auto &job : jobs) {
-        std::cout << "Read scene '" << job.scenePath << "'..." << std::flush;
-        Scene s(job.scenePath);
+    // the profiler only records phases of this process, not of forked workers
+    Profiler::enable(profile || !traceFile.empty());
+
+    auto loadScene = [&](const std::string &_path) {
+        std::unique_ptr<Scene> scene(new Scene(_path));
+        scene->set_ray_reordering(reorderRays);
+        scene->set_frustum_culling(frustumCulling);
+        scene->set_min_contribution(minContribution);
+        scene->set_russian_roulette(russianRoulette);
+        scene->set_area_light_samples(areaLightSamples);
+        if (shadowMapResolution) scene->set_shadow_maps(shadowMapResolution, shadowBias);
+        return scene;
+    };
+
+    // Several scenes are pipelined: while scene N renders, scene N+1 loads
+    // on a background thread and image N-1 is written by another one. Each
+    // stage holds at most one scene or image, and the next scene is only
+    // loaded early while the resident set is below pipelineMemory. Forked
+    // workers must not be started while the loader thread may hold locks,
+    // so --workers disables the pipeline. The loader's messages are
+    // collected and printed when the scene is picked up.
+    const bool pipelined = pipeline && jobs.size() > 1 && workers <= 1;
+    struct LoadedScene
+    {
+        std::unique_ptr<Scene> scene;
+        std::string log;
+    };
+    std::future<LoadedScene> nextScene;
+    std::future<bool> pendingWrite;
+    std::string pendingPath;
+    auto finishWrite = [&]() {
+        if (pendingWrite.valid() && !pendingWrite.get())
+            std::cerr << "Cannot write " << pendingPath << "\n";
+    };
+
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        const RaytraceJob &job = jobs[j];
+        const uint64_t jobStart = Profiler::now();
+        auto reportProfile = [&]() {
+            if (!profile) return;
+            std::cout << "Phases of '" << job.scenePath << "':\n";
+            Profiler::print_summary(std::cout, jobStart);
+        };
+
+        std::unique_ptr<Scene> scene;
+        if (nextScene.valid()) {
+            std::cout << "Wait for scene '" << job.scenePath << "'..." << std::flush;
+            LoadedScene loaded = nextScene.get();
+            std::cout << "\nRead scene '" << job.scenePath << "' in the background..." << loaded.log;
+            scene = std::move(loaded.scene);
+        }
+        else {
+            std::cout << "Read scene '" << job.scenePath << "'..." << std::flush;
+            scene = loadScene(job.scenePath);
+        }
+        Scene &s = *scene;
         std::cout << "\ndone (" << s.numObjects() << " objects)\n";
 
+        // account the scene right after loading (before the next scene
+        // loads in the background), and again with the framebuffer and the
+        // resident set after rendering, when lazy BVHs and shadow maps exist
+        MemoryReport loaded;
+        if (memoryReport || !memoryJson.empty()) {
+            s.memory_usage(loaded);
+            loaded.snapshot("load");
+            if (memoryReport) {
+                std::cout << "After loading:\n";
+                loaded.print(std::cout);
+            }
+        }
+        auto reportMemory = [&](const Image &_image) {
+            if (!memoryReport && memoryJson.empty()) return;
+            MemoryReport memory;
+            s.memory_usage(memory);
+            memory.add("framebuffer", "image", _image.memory());
+            memory.snapshots = loaded.snapshots;
+            memory.snapshot("render");
+            if (memoryReport) {
+                std::cout << "After rendering:\n";
+                memory.print(std::cout);
+            }
+            if (!memoryJson.empty()) {
+                std::ofstream ofs(memoryJson);
+                memory.write_json(ofs);
+                if (!ofs) {
+                    std::cerr << "Cannot write " << memoryJson << "\n";
+                    exit(1);
+                }
+            }
+        };
+
+        if (pipelined && j + 1 < jobs.size() &&
+            (pipelineMemory == 0.0 || ResourceUsage::now().rss < pipelineMemory * 1024.0 * 1024.0)) {
+            nextScene = std::async(std::launch::async, [&loadScene](const std::string &_path) {
+                LogCapture capture;
+                LoadedScene loaded;
+                loaded.scene = loadScene(_path);
+                loaded.log = capture.str();
+                return loaded;
+            }, jobs[j + 1].scenePath);
+        }
+
+        // animation: deform the morph meshes and render each frame
+        if (frames > 1) {
+            const size_t dot = job.outPath.find_last_of('.');
+            const std::string stem = job.outPath.substr(0, dot);
+            const std::string extension = (dot == std::string::npos) ? "" : job.outPath.substr(dot);
+            Image image;
+            for (int f = 0; f < frames; ++f) {
+                StopWatch morph, render;
+                morph.start();
+                s.set_time(double(f) / (frames - 1));
+                morph.stop();
+                render.start();
+                image = s.render();
+                render.stop();
+
+                char number[16];
+                snprintf(number, sizeof(number), "_%04d", f);
+                {
+                    ProfileScope scope("write image");
+                    if (!image.write(stem + number + extension))
+                        std::cerr << "Cannot write " << stem + number + extension << "\n";
+                }
+                std::cout << "Frame " << f << ": morph " << morph << ", render " << render << "\n";
+            }
+            reportMemory(image);
+            reportProfile();
+            continue;
+        }
+
         StopWatch timer;
         std::cout << "Ray tracing..." << std::flush;
         timer.start();
-        auto image = s.render();
+        Image image;
+        Region frame, rendered;
+        std::vector<Region> tiles;
+        frame.x1 = s.getCamera().width;
+        frame.y1 = s.getCamera().height;
+        double completed = 1.0;
+        if (progressive)
+            image = s.render_progressive(timeBudget, completed);
+        else if (!sharded)
+            image = s.render();
+        else {
+            // render the tiles of this shard inside the region (clamped to the frame)
+            rendered = hasRegion ? region : frame;
+            rendered.x0 = std::max(rendered.x0, 0);
+            rendered.y0 = std::max(rendered.y0, 0);
+            rendered.x1 = std::min(rendered.x1, frame.x1);
+            rendered.y1 = std::min(rendered.y1, frame.y1);
+            if (rendered.empty()) {
+                std::cerr << "\nEmpty region\n";
+                exit(1);
+            }
+            tiles = shard_tiles(split_into_tiles(rendered, 64), shardIndex, shardCount);
+            render_tiles(s, rendered, tiles, workers, image);
+        }
         timer.stop();
         std::cout << " done (" << timer << ")\n";
+        if (progressive)
+            std::cout << "  refinement: " << 100.0 * completed << "% completed\n";
+
+        const RenderStats &stats = s.stats();
+        std::cout << "  rays: " << stats.primary_rays << " primary, "
+                  << stats.secondary_rays << " secondary, hit rate "
+                  << 100.0 * stats.hit_rate() << "%, "
+                  << stats.rays() / (1000.0 * timer.elapsed()) << " Mrays/s\n";
+        if (stats.tile_objects)
+            std::cout << "  frustum culling: " << 100.0 * stats.tile_candidates / stats.tile_objects
+                      << "% of objects per tile tested by primary rays\n";
+
+        size_t mapped = 0, resident = 0;
+        for (const auto &o : s.getObjects()) {
+            if (auto mesh = dynamic_cast<const Mesh *>(o)) {
+                mapped   += mesh->mapped_bytes();
+                resident += mesh->resident_bytes();
+            }
+        }
+        if (mapped)
+            std::cout << "  out-of-core meshes: " << mapped / (1024.0*1024.0) << " MB mapped, "
+                      << resident / (1024.0*1024.0) << " MB resident\n";
+        std::cout << "  " << ResourceUsage::now() << "\n";
+        reportMemory(image);
 
-        std::cout << "Write image...";
-        image.write(job.outPath);
+        if (shardCount > 1) {
+            std::cout << "Write partial image (" << tiles.size() << " tiles)...";
+            if (!write_shard(job.outPath, frame.x1, frame.y1, rendered, image, tiles)) {
+                std::cerr << "\nCannot write " << job.outPath << "\n";
+                exit(1);
+            }
+        }
+        else if (pipelined) {
+            // at most one image waits for the disk
+            finishWrite();
+            std::cout << "Write image in the background...";
+            std::shared_ptr<Image> written = std::make_shared<Image>(std::move(image));
+            pendingPath = job.outPath;
+            pendingWrite = std::async(std::launch::async, [written](const std::string &_path) {
+                ProfileScope scope("write image", _path);
+                return written->write(_path);
+            }, pendingPath);
+        }
+        else {
+            std::cout << "Write image...";
+            ProfileScope scope("write image", job.outPath);
+            if (!image.write(job.outPath))
+                std::cerr << "\nCannot write " << job.outPath << "\n";
+        }
         std::cout << "done\n";
+        reportProfile();
+    }
+    finishWrite();
+
+    if (!traceFile.empty() && !Profiler::write_trace(traceFile)) {
+        std::cerr << "Cannot write " << traceFile << "\n";
+        exit(1);
     }
 }
@@ -0,0 +1,117 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== includes =================================================================
+
+#include "RenderProtocol.h"
+
+#ifndef _WIN32
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#  include <climits>
+#  include <cstdlib>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+
+int main() {
+    std::cerr << "render_client requires Unix domain sockets\n";
+    return 1;
+}
+
+#else
+
+/// absolute version of \c _path, which does not have to exist yet
+static std::string absolute_path(const std::string &_path) {
+    if (!_path.empty() && _path[0] == '/') return _path;
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return _path;
+    return std::string(cwd) + "/" + _path;
+}
+
+/// Program entry point.
+int main(int argc, char **argv) {
+    RenderRequest request;
+    std::vector<std::string> args;
+    bool badOption = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        auto read_vec3 = [&](vec3 &v) {
+            if (i + 3 >= argc) return false;
+            for (int j = 0; j < 3; ++j) v[j] = atof(argv[++i]);
+            return true;
+        };
+        if (arg == "--shutdown") request.shutdown = true;
+        else if (arg == "--coherent") request.coherent = true;
+        else if (arg == "--priority" && i + 1 < argc) request.priority = atoi(argv[++i]);
+        else if (arg == "--size" && i + 2 < argc) {
+            request.width  = unsigned(std::max(1, atoi(argv[++i])));
+            request.height = unsigned(std::max(1, atoi(argv[++i])));
+        }
+        else if (arg == "--eye")    badOption |= !(request.set_eye    = read_vec3(request.eye));
+        else if (arg == "--center") badOption |= !(request.set_center = read_vec3(request.center));
+        else if (arg == "--up")     badOption |= !(request.set_up     = read_vec3(request.up));
+        else if (arg == "--fovy" && i + 1 < argc) {
+            request.set_fovy = true;
+            request.fovy = atof(argv[++i]);
+        }
+        else if (arg.compare(0, 2, "--") == 0) badOption = true;
+        else args.push_back(arg);
+    }
+
+    const bool valid = !badOption && (request.shutdown ? args.size() == 1 : args.size() == 3);
+    if (!valid) {
+        std::cerr << "Usage: " << argv[0] << " socket [options] input.sce output.tga\n";
+        std::cerr << "Or: " << argv[0] << " socket --shutdown\n";
+        std::cerr << "Options:\n";
+        std::cerr << "  --priority P          render before requests with lower priority (default 0)\n";
+        std::cerr << "  --size W H            override the image resolution\n";
+        std::cerr << "  --eye X Y Z           override the camera position\n";
+        std::cerr << "  --center X Y Z        override the point the camera looks at\n";
+        std::cerr << "  --up X Y Z            override the camera's up direction\n";
+        std::cerr << "  --fovy F              override the vertical opening angle\n";
+        std::cerr << "  --coherent            trace reflected rays in sorted per-tile batches\n";
+        std::cerr << std::flush;
+        exit(1);
+    }
+    if (!request.shutdown) {
+        request.scene  = absolute_path(args[1]);
+        request.output = absolute_path(args[2]);
+    }
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, args[0].c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr *)&address, sizeof(address)) != 0) {
+        std::cerr << "Cannot connect to " << args[0] << ": " << strerror(errno) << "\n";
+        exit(1);
+    }
+
+    std::string response;
+    if (!write_line(fd, request.to_string()) || !read_line(fd, response)) {
+        std::cerr << "No response from " << args[0] << "\n";
+        exit(1);
+    }
+    close(fd);
+
+    std::cout << response << "\n";
+    return response.compare(0, 2, "ok") == 0 ? 0 : 1;
+}
+
+#endif
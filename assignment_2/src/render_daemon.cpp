@@ -0,0 +1,289 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+//== includes =================================================================
+
+#include "StopWatch.h"
+#include "Scene.h"
+#include "RenderProtocol.h"
+
+#ifndef _WIN32
+#  include <sys/socket.h>
+#  include <sys/time.h>
+#  include <sys/stat.h>
+#  include <sys/un.h>
+#  include <signal.h>
+#  include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+
+int main() {
+    std::cerr << "render_daemon requires Unix domain sockets\n";
+    return 1;
+}
+
+#else
+
+/// a parsed scene together with the modification times of its files
+/// (scene, meshes, morph targets) when it was loaded
+struct CachedScene {
+    std::unique_ptr<Scene> scene;
+    std::vector<std::pair<std::string, time_t>> mtimes;
+    uint64_t last_use;
+};
+
+/// modification time of \c _path, or 0 if it cannot be found
+static time_t modification_time(const std::string &_path) {
+    struct stat st;
+    return stat(_path.c_str(), &st) == 0 ? st.st_mtime : 0;
+}
+
+/// a request waiting in the queue, answered on socket fd
+struct QueuedRequest {
+    RenderRequest request;
+    int fd;
+    uint64_t sequence;
+    StopWatch waiting;
+
+    /// higher priority first, then first come first served
+    bool operator<(const QueuedRequest &_other) const {
+        if (request.priority != _other.request.priority)
+            return request.priority < _other.request.priority;
+        return sequence > _other.sequence;
+    }
+};
+
+/// The scene cache and request queue of the daemon. Requests are rendered
+/// one after another by a single thread, each render uses all cores.
+class RenderDaemon {
+public:
+    explicit RenderDaemon(size_t _cache_size) : cache_size(_cache_size) {}
+
+    /// queue a request, it will be answered on \c _fd
+    void push(const RenderRequest &_request, int _fd) {
+        std::lock_guard<std::mutex> lock(mutex);
+        QueuedRequest q{_request, _fd, sequence++, StopWatch()};
+        q.waiting.start();
+        queue.push(q);
+        wakeup.notify_one();
+    }
+
+    /// stop after the queued requests have been answered
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        wakeup.notify_one();
+    }
+
+    /// render queued requests until finish() is called
+    void run() {
+        for (;;) {
+            QueuedRequest q;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this]() { return finished || !queue.empty(); });
+                if (queue.empty()) return;
+                q = queue.top();
+                queue.pop();
+            }
+            q.waiting.stop();
+            write_line(q.fd, answer(q.request, q.waiting.elapsed()));
+            close(q.fd);
+        }
+    }
+
+private:
+    /// render a request and return the response line
+    std::string answer(const RenderRequest &_r, double _wait_ms) {
+        std::ostringstream response;
+        try {
+            bool cached;
+            StopWatch load;
+            load.start();
+            Scene &scene = get_scene(_r.scene, cached);
+            load.stop();
+
+            // apply the overrides to a copy of the scene's camera, the
+            // original is restored even if rendering throws
+            struct RestoreCamera {
+                Scene &scene;
+                const Camera camera;
+                ~RestoreCamera() { scene.setCamera(camera); }
+            } restore{scene, scene.getCamera()};
+            Camera camera = restore.camera;
+            if (_r.width && _r.height) { camera.width = _r.width; camera.height = _r.height; }
+            if (_r.set_eye)    camera.eye    = _r.eye;
+            if (_r.set_center) camera.center = _r.center;
+            if (_r.set_up)     camera.up     = _r.up;
+            if (_r.set_fovy)   camera.fovy   = _r.fovy;
+            camera.init();
+
+            StopWatch render;
+            render.start();
+            scene.setCamera(camera);
+            scene.set_ray_reordering(_r.coherent);
+            Image image = scene.render();
+            render.stop();
+
+            if (!image.write(_r.output))
+                return "error cannot write " + _r.output;
+
+            response << "ok " << _r.output << ' ' << camera.width << ' ' << camera.height
+                     << " cached " << cached << " wait_ms " << _wait_ms
+                     << " load_ms " << load.elapsed() << " render_ms " << render.elapsed()
+                     << " rays " << scene.stats().rays();
+            std::cout << _r.to_string() << " -> " << render << "\n" << std::flush;
+        }
+        catch (const std::exception &e) {
+            return std::string("error ") + e.what();
+        }
+        return response.str();
+    }
+
+    /// the scene loaded from \c _path, reloaded if the scene file or one of
+    /// the files it references has changed
+    Scene &get_scene(const std::string &_path, bool &_cached) {
+        if (!modification_time(_path))
+            throw std::runtime_error("cannot find scene " + _path);
+
+        auto it = cache.find(_path);
+        _cached = (it != cache.end() &&
+                   std::all_of(it->second.mtimes.begin(), it->second.mtimes.end(),
+                               [](const std::pair<std::string, time_t> &_file) {
+                                   return modification_time(_file.first) == _file.second;
+                               }));
+        if (!_cached) {
+            if (it != cache.end()) cache.erase(it);
+
+            // evict the least recently used scene
+            if (cache.size() >= cache_size) {
+                auto lru = cache.begin();
+                for (auto i = cache.begin(); i != cache.end(); ++i)
+                    if (i->second.last_use < lru->second.last_use) lru = i;
+                std::cout << "evict " << lru->first << "\n";
+                cache.erase(lru);
+            }
+
+            std::cout << "load " << _path << "\n";
+            CachedScene entry{std::unique_ptr<Scene>(new Scene(_path)), {}, 0};
+            for (const std::string &file : entry.scene->source_files())
+                entry.mtimes.push_back(std::make_pair(file, modification_time(file)));
+            it = cache.insert(std::make_pair(_path, std::move(entry))).first;
+        }
+
+        it->second.last_use = ++use_counter;
+        return *it->second.scene;
+    }
+
+private:
+    /// maximum number of cached scenes
+    size_t cache_size;
+
+    /// parsed scenes by path
+    std::map<std::string, CachedScene> cache;
+    uint64_t use_counter = 0;
+
+    /// pending requests
+    std::priority_queue<QueuedRequest> queue;
+    uint64_t sequence = 0;
+    bool finished = false;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+};
+
+/// Program entry point.
+int main(int argc, char **argv) {
+    size_t cacheSize = 8;
+    int readTimeout = 5;
+    std::string socketPath;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--cache" && i + 1 < argc) cacheSize = size_t(std::max(1, atoi(argv[++i])));
+        else if (std::string(argv[i]) == "--read-timeout" && i + 1 < argc) readTimeout = std::max(1, atoi(argv[++i]));
+        else if (socketPath.empty()) socketPath = argv[i];
+        else socketPath.clear(), i = argc;
+    }
+    sockaddr_un address;
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Usage: " << argv[0] << " [--cache N] [--read-timeout S] socket\n";
+        std::cerr << "Renders requests sent by render_client, keeping up to N parsed scenes (default 8).\n";
+        std::cerr << "Clients that do not send their request within S seconds (default 5) are dropped.\n";
+        std::cerr << std::flush;
+        exit(1);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    unlink(socketPath.c_str());
+    if (server < 0 || bind(server, (sockaddr *)&address, sizeof(address)) != 0 || listen(server, 64) != 0) {
+        std::cerr << "Cannot listen on " << socketPath << ": " << strerror(errno) << "\n";
+        exit(1);
+    }
+    std::cout << "Listening on " << socketPath << "\n" << std::flush;
+
+    RenderDaemon daemon(cacheSize);
+    std::thread worker([&daemon]() { daemon.run(); });
+
+    // read one request per connection and queue it
+    for (;;) {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // a client that never completes its line must not block the others
+        timeval timeout;
+        timeout.tv_sec  = readTimeout;
+        timeout.tv_usec = 0;
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        std::string line, error;
+        RenderRequest request;
+        if (!read_line(client, line) || !request.parse(line, error)) {
+            write_line(client, "error " + (error.empty() ? std::string("incomplete request") : error));
+            close(client);
+        }
+        else if (request.shutdown) {
+            write_line(client, "ok");
+            close(client);
+            break;
+        }
+        else {
+            daemon.push(request, client);
+        }
+    }
+
+    close(server);
+    unlink(socketPath.c_str());
+    daemon.finish();
+    worker.join();
+}
+
+#endif
@@ -0,0 +1,381 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef SIMD_H
+#define SIMD_H
+
+
+//== INCLUDES =================================================================
+
+/// \file simd.h Four-lane double and float types for the SIMD backend of
+/// vec3 and for structure-of-arrays code.
+///
+/// The backend is selected at compile time by \c VEC3_SIMD (set by the CMake
+/// option \c RAYTRACE_SIMD): 0 uses plain arrays, 1 uses SSE2 (two registers
+/// per double4), 2 uses AVX (one register per double4). float4 uses SSE
+/// whenever VEC3_SIMD is not 0. All backends compute bit-identical results.
+
+#ifndef VEC3_SIMD
+#define VEC3_SIMD 0
+#endif
+
+#if VEC3_SIMD >= 2
+#  ifndef __AVX__
+#    error "VEC3_SIMD=2 requires AVX, compile with -mavx"
+#  endif
+#  include <immintrin.h>
+#elif VEC3_SIMD == 1
+#  include <emmintrin.h>
+#endif
+
+#include <cmath>
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class double4 simd.h
+/// Four doubles that are processed in parallel. Comparisons return a bit
+/// mask with bit i set for lane i. With AVX the lanes are only aligned to
+/// 16 bytes, since C++11 containers do not provide the 32 bytes that
+/// __m256d requires; compilers other than GCC and Clang keep them in memory.
+struct double4
+{
+#if VEC3_SIMD >= 2 && defined(__GNUC__)
+    typedef double m256d_16 __attribute__((vector_size(32), aligned(16)));
+    m256d_16 v;
+    __m256d get() const { return v; }
+    void set(__m256d _v) { v = _v; }
+#elif VEC3_SIMD >= 2
+    alignas(16) double d[4];
+    __m256d get() const { return _mm256_loadu_pd(d); }
+    void set(__m256d _v) { _mm256_storeu_pd(d, _v); }
+#elif VEC3_SIMD == 1
+    __m128d lo, hi;
+#else
+    double v[4];
+#endif
+
+    /// uninitialized lanes
+    double4() {}
+
+    /// all lanes set to \c _s
+    explicit double4(double _s)
+    {
+#if VEC3_SIMD >= 2
+        set(_mm256_set1_pd(_s));
+#elif VEC3_SIMD == 1
+        lo = hi = _mm_set1_pd(_s);
+#else
+        v[0] = v[1] = v[2] = v[3] = _s;
+#endif
+    }
+
+    /// lanes set to \c _a, \c _b, \c _c, \c _d
+    double4(double _a, double _b, double _c, double _d)
+    {
+#if VEC3_SIMD >= 2
+        set(_mm256_set_pd(_d, _c, _b, _a));
+#elif VEC3_SIMD == 1
+        lo = _mm_set_pd(_b, _a);
+        hi = _mm_set_pd(_d, _c);
+#else
+        v[0] = _a; v[1] = _b; v[2] = _c; v[3] = _d;
+#endif
+    }
+
+    /// load four (not necessarily aligned) doubles
+    static double4 load(const double* _p)
+    {
+        double4 r;
+#if VEC3_SIMD >= 2
+        r.set(_mm256_loadu_pd(_p));
+#elif VEC3_SIMD == 1
+        r.lo = _mm_loadu_pd(_p);
+        r.hi = _mm_loadu_pd(_p + 2);
+#else
+        for (int i=0; i<4; ++i) r.v[i] = _p[i];
+#endif
+        return r;
+    }
+
+    /// store the lanes to four (not necessarily aligned) doubles
+    void store(double* _p) const
+    {
+#if VEC3_SIMD >= 2
+        _mm256_storeu_pd(_p, get());
+#elif VEC3_SIMD == 1
+        _mm_storeu_pd(_p, lo);
+        _mm_storeu_pd(_p + 2, hi);
+#else
+        for (int i=0; i<4; ++i) _p[i] = v[i];
+#endif
+    }
+
+    /// read/write lane \c _i
+    double& operator[](int _i) { return reinterpret_cast<double*>(this)[_i]; }
+
+    /// read lane \c _i (without a detour through memory if possible)
+    double operator[](int _i) const
+    {
+#if VEC3_SIMD >= 2 && defined(__GNUC__)
+        return v[_i];
+#elif VEC3_SIMD == 1 && defined(__GNUC__)
+        return _i < 2 ? lo[_i] : hi[_i - 2];
+#else
+        return reinterpret_cast<const double*>(this)[_i];
+#endif
+    }
+
+    /// (lane0 + lane1) + lane2, in this order
+    double sum3() const
+    {
+#if VEC3_SIMD >= 2
+        const __m256d a = get();
+        const __m128d l = _mm256_castpd256_pd128(a);
+        const __m128d h = _mm256_extractf128_pd(a, 1);
+        return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(l, _mm_unpackhi_pd(l, l)), h));
+#elif VEC3_SIMD == 1
+        return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)), hi));
+#else
+        return v[0] + v[1] + v[2];
+#endif
+    }
+
+    /// lanes rotated to (1, 2, 0, 3)
+    double4 yzx() const
+    {
+#if VEC3_SIMD >= 2 && defined(__AVX2__)
+        double4 r; r.set(_mm256_permute4x64_pd(get(), _MM_SHUFFLE(3, 0, 2, 1))); return r;
+#elif VEC3_SIMD >= 2
+        const __m256d a = get();
+        const __m128d l = _mm256_castpd256_pd128(a);
+        const __m128d h = _mm256_extractf128_pd(a, 1);
+        double4 r;
+        r.set(_mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_shuffle_pd(l, h, 1)),
+                                   _mm_shuffle_pd(l, h, 2), 1));
+        return r;
+#elif VEC3_SIMD == 1
+        double4 r;
+        r.lo = _mm_shuffle_pd(lo, hi, 1);
+        r.hi = _mm_shuffle_pd(lo, hi, 2);
+        return r;
+#else
+        return double4(v[1], v[2], v[0], v[3]);
+#endif
+    }
+
+    /// lanes rotated to (2, 0, 1, 3)
+    double4 zxy() const
+    {
+#if VEC3_SIMD >= 2 && defined(__AVX2__)
+        double4 r; r.set(_mm256_permute4x64_pd(get(), _MM_SHUFFLE(3, 1, 0, 2))); return r;
+#elif VEC3_SIMD >= 2
+        const __m256d a = get();
+        const __m128d l = _mm256_castpd256_pd128(a);
+        const __m128d h = _mm256_extractf128_pd(a, 1);
+        double4 r;
+        r.set(_mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_shuffle_pd(h, l, 0)),
+                                   _mm_shuffle_pd(l, h, 3), 1));
+        return r;
+#elif VEC3_SIMD == 1
+        double4 r;
+        r.lo = _mm_shuffle_pd(hi, lo, 0);
+        r.hi = _mm_shuffle_pd(lo, hi, 3);
+        return r;
+#else
+        return double4(v[2], v[0], v[1], v[3]);
+#endif
+    }
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+#if VEC3_SIMD >= 2
+#  define DOUBLE4_OP(name, intrinsic, expr) \
+    inline double4 name(const double4& a, const double4& b) \
+    { double4 r; r.set(_mm256_##intrinsic##_pd(a.get(), b.get())); return r; }
+#elif VEC3_SIMD == 1
+#  define DOUBLE4_OP(name, intrinsic, expr) \
+    inline double4 name(const double4& a, const double4& b) \
+    { double4 r; r.lo = _mm_##intrinsic##_pd(a.lo, b.lo); r.hi = _mm_##intrinsic##_pd(a.hi, b.hi); return r; }
+#else
+#  define DOUBLE4_OP(name, intrinsic, expr) \
+    inline double4 name(const double4& a, const double4& b) \
+    { double4 r; for (int i=0; i<4; ++i) r.v[i] = expr; return r; }
+#endif
+
+/// lane-wise sum
+DOUBLE4_OP(operator+, add, a.v[i] + b.v[i])
+/// lane-wise difference
+DOUBLE4_OP(operator-, sub, a.v[i] - b.v[i])
+/// lane-wise product
+DOUBLE4_OP(operator*, mul, a.v[i] * b.v[i])
+/// lane-wise quotient
+DOUBLE4_OP(operator/, div, a.v[i] / b.v[i])
+/// lane-wise (a < b ? a : b), the same as std::min(b, a)
+DOUBLE4_OP(min, min, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+/// lane-wise (a > b ? a : b), the same as std::max(b, a)
+DOUBLE4_OP(max, max, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+
+#undef DOUBLE4_OP
+
+/// lane-wise negation (flips the sign bit like the scalar minus)
+inline double4 operator-(const double4& a)
+{
+#if VEC3_SIMD >= 2
+    double4 r; r.set(_mm256_xor_pd(a.get(), _mm256_set1_pd(-0.0))); return r;
+#elif VEC3_SIMD == 1
+    const __m128d sign = _mm_set1_pd(-0.0);
+    double4 r; r.lo = _mm_xor_pd(a.lo, sign); r.hi = _mm_xor_pd(a.hi, sign); return r;
+#else
+    return double4(-a.v[0], -a.v[1], -a.v[2], -a.v[3]);
+#endif
+}
+
+/// bit i is set if a[i] < b[i]
+inline int less(const double4& a, const double4& b)
+{
+#if VEC3_SIMD >= 2
+    return _mm256_movemask_pd(_mm256_cmp_pd(a.get(), b.get(), _CMP_LT_OQ));
+#elif VEC3_SIMD == 1
+    return _mm_movemask_pd(_mm_cmplt_pd(a.lo, b.lo)) | (_mm_movemask_pd(_mm_cmplt_pd(a.hi, b.hi)) << 2);
+#else
+    int m = 0;
+    for (int i=0; i<4; ++i) m |= (a.v[i] < b.v[i]) << i;
+    return m;
+#endif
+}
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class float4 simd.h
+/// Four floats that are processed in parallel (SSE unless VEC3_SIMD is 0).
+struct float4
+{
+#if VEC3_SIMD
+    __m128 v;
+#else
+    float v[4];
+#endif
+
+    /// uninitialized lanes
+    float4() {}
+
+    /// all lanes set to \c _s
+    explicit float4(float _s)
+    {
+#if VEC3_SIMD
+        v = _mm_set1_ps(_s);
+#else
+        v[0] = v[1] = v[2] = v[3] = _s;
+#endif
+    }
+
+    /// lanes set to \c _a, \c _b, \c _c, \c _d
+    float4(float _a, float _b, float _c, float _d)
+    {
+#if VEC3_SIMD
+        v = _mm_set_ps(_d, _c, _b, _a);
+#else
+        v[0] = _a; v[1] = _b; v[2] = _c; v[3] = _d;
+#endif
+    }
+
+    /// load four (not necessarily aligned) floats
+    static float4 load(const float* _p)
+    {
+        float4 r;
+#if VEC3_SIMD
+        r.v = _mm_loadu_ps(_p);
+#else
+        for (int i=0; i<4; ++i) r.v[i] = _p[i];
+#endif
+        return r;
+    }
+
+    /// store the lanes to four (not necessarily aligned) floats
+    void store(float* _p) const
+    {
+#if VEC3_SIMD
+        _mm_storeu_ps(_p, v);
+#else
+        for (int i=0; i<4; ++i) _p[i] = v[i];
+#endif
+    }
+
+    /// read/write lane \c _i
+    float& operator[](int _i) { return reinterpret_cast<float*>(this)[_i]; }
+
+    /// read lane \c _i
+    float operator[](int _i) const { return reinterpret_cast<const float*>(this)[_i]; }
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+#if VEC3_SIMD
+#  define FLOAT4_OP(name, intrinsic, expr) \
+    inline float4 name(const float4& a, const float4& b) \
+    { float4 r; r.v = _mm_##intrinsic##_ps(a.v, b.v); return r; }
+#else
+#  define FLOAT4_OP(name, intrinsic, expr) \
+    inline float4 name(const float4& a, const float4& b) \
+    { float4 r; for (int i=0; i<4; ++i) r.v[i] = expr; return r; }
+#endif
+
+/// lane-wise sum
+FLOAT4_OP(operator+, add, a.v[i] + b.v[i])
+/// lane-wise difference
+FLOAT4_OP(operator-, sub, a.v[i] - b.v[i])
+/// lane-wise product
+FLOAT4_OP(operator*, mul, a.v[i] * b.v[i])
+/// lane-wise quotient
+FLOAT4_OP(operator/, div, a.v[i] / b.v[i])
+/// lane-wise (a < b ? a : b)
+FLOAT4_OP(min, min, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+/// lane-wise (a > b ? a : b)
+FLOAT4_OP(max, max, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+
+#undef FLOAT4_OP
+
+/// bit i is set if a[i] < b[i]
+inline int less(const float4& a, const float4& b)
+{
+#if VEC3_SIMD
+    return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v));
+#else
+    int m = 0;
+    for (int i=0; i<4; ++i) m |= (a.v[i] < b.v[i]) << i;
+    return m;
+#endif
+}
+
+/// lane-wise square root
+inline float4 sqrt(const float4& a)
+{
+#if VEC3_SIMD
+    float4 r; r.v = _mm_sqrt_ps(a.v); return r;
+#else
+    float4 r;
+    for (int i=0; i<4; ++i) r.v[i] = std::sqrt(a.v[i]);
+    return r;
+#endif
+}
+
+
+//=============================================================================
+#endif // SIMD_H defined
+//=============================================================================
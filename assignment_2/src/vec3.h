@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <math.h>
 #include <algorithm>
+#include "simd.h"
 
 
 //== CLASS DEFINITION =========================================================
@@ -30,18 +31,41 @@
 /// 3D points and 3D color. You can access the individual components either by
 /// x,y,z or by r,g,b. The vec3 class provides all commonly used mathematical
 /// operations.
+///
+/// If VEC3_SIMD is set (see simd.h), the components are stored in the first
+/// three lanes of a double4 whose fourth lane is zero, and the operations
+/// run on all four lanes at once. The results are the same in both cases.
 /// \sa vec3.h
 class vec3
 {
 private:
 
+#if VEC3_SIMD
+    double4 data_;
+#else
     double data_[3];
+#endif
 
 public:
 
     /// default constructor
     vec3() {}
 
+#if VEC3_SIMD
+    /// construct with scalar value that is assigned to x, y, and z
+    /// The "explicit" keyword prevents automatic conversions
+    /// from double to vec3, which generally should indicate bugs.
+    explicit vec3(double _s) : data_(_s,_s,_s,0.0) {}
+
+    /// construct with x,y,z values
+    vec3(double _x, double _y, double _z) : data_(_x,_y,_z,0.0) {}
+
+    /// construct from the lanes x,y,z,0 of \c _lanes
+    explicit vec3(const double4& _lanes) : data_(_lanes) {}
+
+    /// the lanes x,y,z,0
+    const double4& lanes() const { return data_; }
+#else
     /// construct with scalar value that is assigned to x, y, and z
     /// The "explicit" keyword prevents automatic conversions
     /// from double to vec3, which generally should indicate bugs.
@@ -49,6 +73,7 @@ public:
 
     /// construct with x,y,z values
     vec3(double _x, double _y, double _z) : data_{_x,_y,_z} {}
+#endif
 
 
     /// read/write the _i'th vector component (_i from 0 to 2)
@@ -69,35 +94,55 @@ public:
     /// multiply this vector by a scalar \c s
     vec3& operator*=(const double s)
     {
+#if VEC3_SIMD
+        data_ = data_ * double4(s);
+#else
         for (int i=0; i<3; ++i) data_[i] *= s;
+#endif
         return *this;
     }
 
     /// divide this vector by a scalar \c s
     vec3& operator/=(const double s)
     {
+#if VEC3_SIMD
+        data_ = data_ / double4(s);
+#else
         for (int i=0; i<3; ++i) data_[i] /= s;
+#endif
         return *this;
     }
 
     /// component-wise multiplication of this vector with vector \c v
     vec3& operator*=(const vec3& v)
     {
+#if VEC3_SIMD
+        data_ = data_ * v.data_;
+#else
         for (int i=0; i<3; ++i) data_[i] *= v[i];
+#endif
         return *this;
     }
 
     /// subtract vector \c v from this vector
     vec3& operator-=(const vec3& v)
     {
+#if VEC3_SIMD
+        data_ = data_ - v.data_;
+#else
         for (int i=0; i<3; ++i) data_[i] -= v[i];
+#endif
         return *this;
     }
 
     /// add vector \c v to this vector
     vec3& operator+=(const vec3& v)
     {
+#if VEC3_SIMD
+        data_ = data_ + v.data_;
+#else
         for (int i=0; i<3; ++i) data_[i] += v[i];
+#endif
         return *this;
     }
 };
@@ -109,77 +154,117 @@ public:
 /// unary minus: turn v into -v
 inline const vec3 operator-(const vec3& v)
 {
+#if VEC3_SIMD
+    return vec3(-v.lanes());
+#else
     return vec3(-v[0], -v[1], -v[2]);
+#endif
 }
 
 /// multiply vector \c v by scalar \c s
 inline const vec3 operator*(const double s, const vec3& v )
 {
+#if VEC3_SIMD
+    return vec3(double4(s) * v.lanes());
+#else
     return vec3(s * v[0],
                 s * v[1],
                 s * v[2]);
+#endif
 }
 
 /// multiply vector \c v by scalar \c s
 inline const vec3 operator*(const vec3& v, const double s)
 {
+#if VEC3_SIMD
+    return vec3(double4(s) * v.lanes());
+#else
     return vec3(s * v[0],
                 s * v[1],
                 s * v[2]);
+#endif
 }
 
 /// component-wise multiplication of vectors \c v0 and \c v1
 inline const vec3 operator*(const vec3& v0, const vec3& v1)
 {
+#if VEC3_SIMD
+    return vec3(v0.lanes() * v1.lanes());
+#else
     return vec3(v0[0] * v1[0],
                 v0[1] * v1[1],
                 v0[2] * v1[2]);
+#endif
 }
 
 /// divide vector \c v by scalar \c s
 inline const vec3 operator/(const vec3& v, const double s)
 {
+#if VEC3_SIMD
+    return vec3(v.lanes() / double4(s));
+#else
     return vec3(v[0] / s,
                 v[1] / s,
                 v[2] / s);
+#endif
 }
 
 /// add two vectors \c v0 and \c v1
 inline const vec3 operator+(const vec3& v0, const vec3& v1)
 {
+#if VEC3_SIMD
+    return vec3(v0.lanes() + v1.lanes());
+#else
     return vec3(v0[0] + v1[0],
                 v0[1] + v1[1],
                 v0[2] + v1[2]);
+#endif
 }
 
 /// subtract vector \c v1 from vector \c v0
 inline const vec3 operator-(const vec3& v0, const vec3& v1)
 {
+#if VEC3_SIMD
+    return vec3(v0.lanes() - v1.lanes());
+#else
     return vec3(v0[0] - v1[0],
                 v0[1] - v1[1],
                 v0[2] - v1[2]);
+#endif
 }
 
 /// compute the component-wise minimum of vectors \c v0 and \c v1
 inline const vec3 min(const vec3& v0, const vec3& v1)
 {
+#if VEC3_SIMD
+    return vec3(min(v1.lanes(), v0.lanes()));
+#else
     return vec3(std::min(v0[0], v1[0]),
                 std::min(v0[1], v1[1]),
                 std::min(v0[2], v1[2]));
+#endif
 }
 
 /// compute the component-wise maximum of vectors \c v0 and \c v1
 inline const vec3 max(const vec3& v0, const vec3& v1)
 {
+#if VEC3_SIMD
+    return vec3(max(v1.lanes(), v0.lanes()));
+#else
     return vec3(std::max(v0[0], v1[0]),
                 std::max(v0[1], v1[1]),
                 std::max(v0[2], v1[2]));
+#endif
 }
 
 /// compute the Euclidean dot product of \c v0 and \c v1
 inline const double dot(const vec3& v0, const vec3& v1)
 {
+#if VEC3_SIMD
+    return (v0.lanes() * v1.lanes()).sum3();
+#else
     return (v0[0]*v1[0] + v0[1]*v1[1] + v0[2]*v1[2]);
+#endif
 }
 
 /// compute the Euclidean norm (length) of a vector \c v
@@ -194,9 +279,13 @@ inline const vec3 normalize(const vec3& v)
     const double n = norm(v);
     if (n != 0.0)
     {
+#if VEC3_SIMD
+        return vec3(v.lanes() / double4(n));
+#else
         return vec3(v[0] / n,
                     v[1] / n,
                     v[2] / n);
+#endif
     }
     return v;
 }
@@ -210,9 +299,15 @@ inline const double distance(const vec3& v0, const vec3& v1)
 /// compute the cross product of \c v0 and \c v1
 inline const vec3 cross(const vec3& v0, const vec3& v1)
 {
+#if VEC3_SIMD
+    const double4& a = v0.lanes();
+    const double4& b = v1.lanes();
+    return vec3(a.yzx() * b.zxy() - a.zxy() * b.yzx());
+#else
     return vec3(v0[1]*v1[2] - v0[2]*v1[1],
                 v0[2]*v1[0] - v0[0]*v1[2],
                 v0[0]*v1[1] - v0[1]*v1[0]);
+#endif
 }
 
 /// reflect vector \c v at normal \c n
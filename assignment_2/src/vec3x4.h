@@ -0,0 +1,180 @@
+//=============================================================================
+//
+//   Exercise code for the lecture
+//   "Introduction to Computer Graphics"
+//   by Prof. Dr. Mario Botsch, Bielefeld University
+//
+//   Copyright (C) Computer Graphics Group, Bielefeld University.
+//
+//=============================================================================
+
+#ifndef VEC3X4_H
+#define VEC3X4_H
+
+
+//== INCLUDES =================================================================
+
+#include "vec3.h"
+#include "simd.h"
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \file vec3x4.h Batches of four vectors in structure-of-arrays layout.
+
+
+/// \class vec3x4 vec3x4.h
+/// Four vec3 stored as one double4 per coordinate, so that an operation on
+/// the batch processes the four vectors in parallel (e.g. a ray against four
+/// boxes or four rays against one triangle). The operations compute the same
+/// values as the corresponding vec3 operations on each vector.
+struct vec3x4
+{
+    double4 x, y, z;
+
+    /// uninitialized vectors
+    vec3x4() {}
+
+    /// four copies of \c _v
+    explicit vec3x4(const vec3& _v) : x(_v[0]), y(_v[1]), z(_v[2]) {}
+
+    /// construct from the coordinates of the four vectors
+    vec3x4(const double4& _x, const double4& _y, const double4& _z) : x(_x), y(_y), z(_z) {}
+
+    /// gather the vectors \c _a, \c _b, \c _c, \c _d
+    vec3x4(const vec3& _a, const vec3& _b, const vec3& _c, const vec3& _d)
+        : x(_a[0], _b[0], _c[0], _d[0]),
+          y(_a[1], _b[1], _c[1], _d[1]),
+          z(_a[2], _b[2], _c[2], _d[2])
+    {}
+
+    /// the \c _i'th vector (_i from 0 to 3)
+    vec3 operator[](int _i) const { return vec3(x[_i], y[_i], z[_i]); }
+
+    /// coordinate \c _k of all four vectors (_k from 0 to 2)
+    const double4& coordinate(int _k) const { return _k == 0 ? x : (_k == 1 ? y : z); }
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+/// add two batches
+inline vec3x4 operator+(const vec3x4& a, const vec3x4& b)
+{
+    return vec3x4(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+/// subtract batch \c b from batch \c a
+inline vec3x4 operator-(const vec3x4& a, const vec3x4& b)
+{
+    return vec3x4(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+/// component-wise product of two batches
+inline vec3x4 operator*(const vec3x4& a, const vec3x4& b)
+{
+    return vec3x4(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+
+/// multiply each vector by its lane of \c s
+inline vec3x4 operator*(const double4& s, const vec3x4& a)
+{
+    return vec3x4(s * a.x, s * a.y, s * a.z);
+}
+
+/// component-wise minimum, like min(vec3, vec3) per vector
+inline vec3x4 min(const vec3x4& a, const vec3x4& b)
+{
+    return vec3x4(min(b.x, a.x), min(b.y, a.y), min(b.z, a.z));
+}
+
+/// component-wise maximum, like max(vec3, vec3) per vector
+inline vec3x4 max(const vec3x4& a, const vec3x4& b)
+{
+    return vec3x4(max(b.x, a.x), max(b.y, a.y), max(b.z, a.z));
+}
+
+/// the four dot products
+inline double4 dot(const vec3x4& a, const vec3x4& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+/// the four cross products
+inline vec3x4 cross(const vec3x4& a, const vec3x4& b)
+{
+    return vec3x4(a.y * b.z - a.z * b.y,
+                  a.z * b.x - a.x * b.z,
+                  a.x * b.y - a.y * b.x);
+}
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// \class vec3fx4 vec3x4.h
+/// Four single precision vectors stored as one float4 per coordinate, for
+/// structure-of-arrays code on float data such as compressed vertices.
+struct vec3fx4
+{
+    float4 x, y, z;
+
+    /// uninitialized vectors
+    vec3fx4() {}
+
+    /// construct from the coordinates of the four vectors
+    vec3fx4(const float4& _x, const float4& _y, const float4& _z) : x(_x), y(_y), z(_z) {}
+
+    /// gather four vectors of three floats each
+    vec3fx4(const float* _a, const float* _b, const float* _c, const float* _d)
+        : x(_a[0], _b[0], _c[0], _d[0]),
+          y(_a[1], _b[1], _c[1], _d[1]),
+          z(_a[2], _b[2], _c[2], _d[2])
+    {}
+
+    /// the \c _i'th vector (_i from 0 to 3), converted to double
+    vec3 operator[](int _i) const { return vec3(x[_i], y[_i], z[_i]); }
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+/// add two batches
+inline vec3fx4 operator+(const vec3fx4& a, const vec3fx4& b)
+{
+    return vec3fx4(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+/// subtract batch \c b from batch \c a
+inline vec3fx4 operator-(const vec3fx4& a, const vec3fx4& b)
+{
+    return vec3fx4(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+/// multiply each vector by its lane of \c s
+inline vec3fx4 operator*(const float4& s, const vec3fx4& a)
+{
+    return vec3fx4(s * a.x, s * a.y, s * a.z);
+}
+
+/// the four dot products
+inline float4 dot(const vec3fx4& a, const vec3fx4& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+/// the four cross products
+inline vec3fx4 cross(const vec3fx4& a, const vec3fx4& b)
+{
+    return vec3fx4(a.y * b.z - a.z * b.y,
+                   a.z * b.x - a.x * b.z,
+                   a.x * b.y - a.y * b.x);
+}
+
+
+//=============================================================================
+#endif // VEC3X4_H defined
+//=============================================================================